@@ -0,0 +1,173 @@
+﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 流量錄製檔 (--capture 錄、--replay 重播)
+// 格式：CaptureHeader 後面接連續的 16 bytes CaptureRecord，依時間排序
+// 只記錄 連線開啟 / 每筆訊息大小 / 連線關閉 與時間，不存內容
+
+#pragma pack(push, 1)
+struct CaptureHeader {
+    char magic[8];            // "HCCAP01"
+    std::uint32_t version;    // 1
+    std::uint32_t record_size; // sizeof(CaptureRecord)
+};
+
+struct CaptureRecord {
+    std::uint64_t time_us;    // 距離開始錄製的微秒
+    std::uint32_t conn;       // 連線編號，依 OPEN 順序從 0 遞增
+    std::uint32_t info;       // 高 2 bit 為種類，低 30 bit 為訊息大小
+
+    enum Kind : std::uint32_t { open = 0, data = 1, close = 2 };
+    Kind kind() const { return static_cast<Kind>(info >> 30); }
+    std::uint32_t length() const { return info & 0x3fffffffu; }
+};
+#pragma pack(pop)
+
+static_assert(sizeof(CaptureRecord) == 16, "capture record must stay 16 bytes");
+
+// 多個 io thread 共用，先累積在 buffer 滿了才寫檔
+class CaptureWriter {
+public:
+    explicit CaptureWriter(const std::string& path)
+        : file_(std::fopen(path.c_str(), "wb")), begin_(std::chrono::steady_clock::now()) {
+        if (file_ == nullptr) throw std::runtime_error("cannot open capture file " + path);
+        CaptureHeader h = {};
+        std::memcpy(h.magic, "HCCAP01", 8);
+        h.version = 1;
+        h.record_size = sizeof(CaptureRecord);
+        std::fwrite(&h, sizeof(h), 1, file_);
+        records_.reserve(4096);
+    }
+    ~CaptureWriter() { close(); }
+
+    std::uint32_t open_connection() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint32_t conn = next_conn_++;
+        append(conn, CaptureRecord::open, 0);
+        return conn;
+    }
+
+    void data(std::uint32_t conn, std::size_t length) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(conn, CaptureRecord::data, length > 0x3fffffffu ? 0x3fffffffu : static_cast<std::uint32_t>(length));
+    }
+
+    void close_connection(std::uint32_t conn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        append(conn, CaptureRecord::close, 0);
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (file_ == nullptr) return;
+        flush();
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+
+private:
+    void append(std::uint32_t conn, CaptureRecord::Kind kind, std::uint32_t length) {
+        if (file_ == nullptr) return;
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin_).count();
+        records_.push_back({ static_cast<std::uint64_t>(us), conn, (static_cast<std::uint32_t>(kind) << 30) | length });
+        if (records_.size() == records_.capacity()) flush();
+    }
+
+    void flush() {
+        std::fwrite(records_.data(), sizeof(CaptureRecord), records_.size(), file_);
+        std::fflush(file_);
+        records_.clear();
+    }
+
+    std::FILE* file_;
+    std::chrono::steady_clock::time_point begin_;
+    std::vector<CaptureRecord> records_;
+    std::uint32_t next_conn_ = 0;
+    std::mutex mutex_;
+};
+
+// 以 mmap 唯讀開啟錄製檔，重播時直接在 mapping 上走訪 record
+class CaptureFile {
+public:
+    explicit CaptureFile(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) throw std::runtime_error("cannot open capture file " + path);
+        LARGE_INTEGER size;
+        GetFileSizeEx(file_, &size);
+        size_ = static_cast<std::size_t>(size.QuadPart);
+        if (size_ > 0) {
+            mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping_ != nullptr) data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) throw std::runtime_error("cannot open capture file " + path);
+        struct stat st;
+        fstat(fd_, &st);
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (p != MAP_FAILED) {
+                data_ = static_cast<const char*>(p);
+                madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+#endif
+        const CaptureHeader* h = reinterpret_cast<const CaptureHeader*>(data_);
+        if (data_ == nullptr || size_ < sizeof(CaptureHeader) || std::memcmp(h->magic, "HCCAP01", 8) != 0
+            || h->record_size != sizeof(CaptureRecord)) {
+            release();
+            throw std::runtime_error("not a capture file " + path);
+        }
+    }
+    ~CaptureFile() { release(); }
+    CaptureFile(const CaptureFile&) = delete;
+    CaptureFile& operator=(const CaptureFile&) = delete;
+
+    // 錄製中途被中斷時最後一筆可能不完整，直接忽略
+    const CaptureRecord* begin() const { return reinterpret_cast<const CaptureRecord*>(data_ + sizeof(CaptureHeader)); }
+    const CaptureRecord* end() const { return begin() + (size_ - sizeof(CaptureHeader)) / sizeof(CaptureRecord); }
+    std::size_t size() const { return end() - begin(); }
+
+private:
+    void release() {
+#ifdef _WIN32
+        if (data_ != nullptr) UnmapViewOfFile(data_);
+        if (mapping_ != nullptr) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+    }
+
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
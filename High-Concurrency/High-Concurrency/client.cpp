@@ -3,11 +3,22 @@
 #include <memory>
 #include <vector>
 #include <thread>
+#include <cstring>
 #include "writelog.h"
+#include "options.h"
+#include "stream_io.h"
+#include "replay.h"
+#include "run_controller.h"
+#include "compress.h"
+#include "payload.h"
 
 using boost::asio::ip::tcp;
 
 Logger g_logger("checkclient");
+RunController g_run;
+CompressConfig g_compress; // --compress ɳsuӡAChT frame
+std::unique_ptr<const PayloadPool> g_payload; // --payload-bytes / --seedAҦsu@
+std::unique_ptr<CaptureWriter> g_capture;     // --capture ɿUCsueXTjpPɶAi --replay
 
 std::string getCurrentSystemTime() {
     auto tt = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -20,66 +31,161 @@ std::string getCurrentSystemTime() {
 
 class ClientSession : public std::enable_shared_from_this<ClientSession> {
 public:
-    ClientSession(boost::asio::io_context& io, const std::string& msg, int doboth)
-        : socket_(io), message_(msg) ,timer_(io), doboth_(doboth){}
+    // label uΦb logFeXeO g_payload  (id, ĴXh) Mw@q
+    ClientSession(boost::asio::io_context& io, const std::string& label, std::uint32_t id, int doboth)
+        : socket_(boost::asio::make_strand(io)), label_(label), id_(id), rx_(payload_rx_size(g_payload->length())),
+        doboth_(doboth), timer_(socket_.get_executor()), frames_(socket_) {}
+    ~ClientSession() {
+        if (captured_) g_capture->close_connection(capture_id_);
+    }
 
     void start(tcp::resolver::results_type endpoints) {
         auto self(shared_from_this());
         boost::asio::async_connect(socket_, endpoints,
             [this, self](boost::system::error_code ec, tcp::endpoint) {  
                 if (!ec) {
-                    //g_logger.log(message_);
+                    //g_logger.log(label_);
+                    if (g_capture) {
+                        capture_id_ = g_capture->open_connection();
+                        captured_ = true;
+                    }
                     if (doboth_ <= 0) doboth_ = 100; //p󵥩0ҳ]w100
+                    if (g_compress.enabled) {
+                        frames_.async_client_hello(g_compress, [this, self](boost::system::error_code ec) {
+                            if (!ec) {
+                                framed_ = true;
+                                do_both(&doboth_);
+                            }
+                            else {
+                                g_logger.log(label_ + "compress hello fail " + ec.message());
+                                g_run.connection_failed();
+                            }
+                        });
+                        return;
+                    }
                     do_both(&doboth_); //̭ƦrN do_write->do-read n
                 }
                 else {
-                    g_logger.log(message_ +"fullllll" + ec.message());
+                    g_logger.log(label_ +"fullllll" + ec.message());
+                    g_run.connection_failed();
                 }
             });
     }
 
 private:
+    // W@h٨Sg / ŪɥƶAP@su@u@ write P@ read
     void do_write() {
+        if (writing_) {
+            ++write_backlog_;
+            return;
+        }
+        writing_ = true;
+        if (captured_) g_capture->data(capture_id_, g_payload->length());
         auto self(shared_from_this());
-        boost::asio::async_write(socket_, boost::asio::buffer(message_),
-            [this, self](boost::system::error_code ec, std::size_t) {
-                if (ec == boost::asio::error::eof) {
-                    g_logger.log("server killed himself in writing session");
-                    socket_.close();
-                }
-                else if (!ec) {
-                    //do_read();
-                }
-                else {
-                    g_logger.log(message_ + "writing fail");
-                }
-            });
+        stamp_sent(write_seq_);
+        const char* data = g_payload->data(g_payload->offset(id_, write_seq_++));
+        auto on_written = [this, self](boost::system::error_code ec, std::size_t) {
+            if (ec == boost::asio::error::eof) {
+                g_logger.log("server killed himself in writing session");
+                socket_.close();
+                return;
+            }
+            if (ec) {
+                g_logger.log(label_ + "writing fail");
+                return;
+            }
+            writing_ = false;
+            if (write_backlog_ > 0) {
+                --write_backlog_;
+                do_write();
+            }
+            maybe_exit();
+        };
+        if (framed_) frames_.async_send(data, g_payload->length(), on_written);
+        else boost::asio::async_write(socket_, boost::asio::buffer(data, g_payload->length()), on_written);
     }
     void do_read() {
+        if (reading_) {
+            ++read_backlog_;
+            return;
+        }
+        reading_ = true;
+        auto self(shared_from_this());
+        verifier_.begin(*g_payload, g_payload->offset(id_, read_seq_++));
+        if (framed_) read_frame(0);
+        else read_chunk();
+    }
+    // jT|h frameAC frame NFwire = ohثe쪺uW bytes
+    void read_frame(std::size_t wire) {
         auto self(shared_from_this());
-        boost::asio::async_read(socket_, boost::asio::buffer(reply_, message_.size()),
+        frames_.async_receive([this, self, wire](boost::system::error_code ec, const char* data, std::size_t length, std::size_t frame_wire, bool more) {
+            if (ec) {
+                g_logger.log("Read error on " + label_ + ": " + ec.message());
+                return;
+            }
+            verifier_.update(data, length);
+            if (more) read_frame(wire + frame_wire);
+            else read_done(wire + frame_wire);
+        });
+    }
+    // jTqŪi rx_ACqŪNArx_ jpTw
+    void read_chunk() {
+        auto self(shared_from_this());
+        std::size_t n = std::min(rx_.size(), verifier_.remaining());
+        boost::asio::async_read(socket_, boost::asio::buffer(rx_.data(), n),
             [this, self](boost::system::error_code ec, std::size_t length) {
                 if (ec == boost::asio::error::eof) {
                     g_logger.log("server killed himself in reading session");
                     socket_.close();
                 }
                 else if (!ec) {
-                    std::string reply(reply_, length);
-                    if (reply == message_) {
-                        std::string date = getCurrentSystemTime();
-                        g_logger.log("Echo OK," + message_ + "Client time = " + date );
-                        // Dsu
-                        //do_exit();
-                    }
-                    else {
-                        g_logger.log("Echo mismatch! " + message_ +" reply = "+ reply);
-                    }
+                    verifier_.update(rx_.data(), length);
+                    if (verifier_.done()) read_done(g_payload->length());
+                    else read_chunk();
                 }
                 else {
-                    g_logger.log("Read error on " + message_ + ": " + ec.message());
+                    g_logger.log("Read error on " + label_ + ": " + ec.message());
                 }
             });
-
+    }
+    void read_done(std::size_t wire) {
+        if (verifier_.done() && verifier_.ok()) {
+            auto sent = sent_at_[(read_seq_ - 1) % sent_at_.size()];
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent);
+            g_run.record(static_cast<std::uint64_t>(us.count()), g_payload->length(), wire);
+            std::string date = getCurrentSystemTime();
+            g_logger.log("Echo OK," + label_ + "Client time = " + date );
+            // Dsu
+            //do_exit();
+        }
+        else {
+            g_run.error();
+            g_logger.log("Echo mismatch! " + label_ + " at byte " + std::to_string(verifier_.error_offset())
+                + " of " + std::to_string(g_payload->length()));
+        }
+        reading_ = false;
+        if (read_backlog_ > 0) {
+            --read_backlog_;
+            do_read();
+        }
+        maybe_exit();
+    }
+    // ChTu}lgXɶA seq b ringF٨SŪ^T ring hɩj
+    void stamp_sent(std::uint32_t seq) {
+        std::uint32_t oldest = reading_ ? read_seq_ - 1 : read_seq_;
+        if (seq - oldest >= sent_at_.size()) {
+            std::vector<std::chrono::steady_clock::time_point> bigger(sent_at_.size() * 2);
+            for (std::uint32_t s = oldest; s != seq; ++s) bigger[s % bigger.size()] = sent_at_[s % sent_at_.size()];
+            sent_at_.swap(bigger);
+        }
+        sent_at_[seq % sent_at_.size()] = std::chrono::steady_clock::now();
+    }
+    // ̫@Aƶ write / read ~
+    void maybe_exit() {
+        if (!exit_requested_ || writing_ || reading_ || write_backlog_ > 0 || read_backlog_ > 0) return;
+        exit_requested_ = false;
+        timer_.cancel();
+        do_exit();
     }
     void do_exit() {
         boost::system::error_code ignored_ec;
@@ -91,18 +197,22 @@ private:
         do_write();
         do_read();
         --(*j);
-        if (*j == 0) {     //@clientsuƶǧ n_su
-            //g_logger.log(message_+"Last connection");
-            timer_.expires_after(boost::asio::chrono::milliseconds(20)); //write/read DPB^Ǯɶ
+        bool last = g_run.timed() ? g_run.finished() : *j == 0; // pɼҦ cool-down 
+        if (last) {     //@clientsuƶǧ n_su
+            //g_logger.log(label_+"Last connection");
+            // ƶTŪ^ӦAFserver @S^ɡAOɫST⦨~
+            exit_requested_ = true;
+            timer_.expires_after(boost::asio::chrono::seconds(10));
             timer_.async_wait([this, self](boost::system::error_code ec) {
-                if (!ec) {
-                    do_exit();
-                }
-                else {
-                    g_logger.log("exit error" + ec.message());
-                }
+                if (ec || !exit_requested_) return;
+                std::uint32_t completed = reading_ ? read_seq_ - 1 : read_seq_;
+                std::uint32_t lost = write_seq_ + static_cast<std::uint32_t>(write_backlog_) - completed;
+                for (std::uint32_t i = 0; i < lost; ++i) g_run.error();
+                g_logger.log(label_ + "exit with " + std::to_string(lost) + " messages not echoed");
+                exit_requested_ = false;
+                do_exit();
                 });
-            
+            maybe_exit();
         }
         else {
             timer_.expires_after(boost::asio::chrono::milliseconds(20)); //Cwrite/read᳣x@ɶ
@@ -117,16 +227,208 @@ private:
         }     
     }
     tcp::socket socket_;
-    std::string message_;
-    char reply_[1024];
+    std::string label_;
+    std::uint32_t id_;
+    std::vector<char> rx_;
+    PayloadVerifier verifier_;
+    std::uint32_t write_seq_ = 0, read_seq_ = 0;
+    bool writing_ = false, reading_ = false;
+    int write_backlog_ = 0, read_backlog_ = 0;
     int doboth_;
     boost::asio::steady_timer timer_;
+    std::vector<std::chrono::steady_clock::time_point> sent_at_ = std::vector<std::chrono::steady_clock::time_point>(16);
+    bool exit_requested_ = false;
+    FrameChannel<tcp::socket> frames_;
+    bool framed_ = false;
+    std::uint32_t capture_id_ = 0;
+    bool captured_ = false;
+};
+
+// yҦGsW@eP@ payloadAPɤ@Ū^ echoAŪg
+// payload Ҧsu@ΥB|קAzerocopy uݭn⧹qŪ
+class StreamClient : public std::enable_shared_from_this<StreamClient> {
+public:
+    StreamClient(boost::asio::io_context& io, const std::vector<char>& payload, const StreamConfig& cfg, StreamStats& stats)
+        : socket_(boost::asio::make_strand(io)), payload_(payload), reply_(cfg.buffer_size),
+        stats_(stats), want_zerocopy_(cfg.zerocopy) {}
+
+    void start(const tcp::resolver::results_type& endpoints) {
+        auto self(shared_from_this());
+        boost::asio::async_connect(socket_, endpoints,
+            [this, self](boost::system::error_code ec, tcp::endpoint) {
+                if (ec) {
+                    g_logger.log("stream connect failed " + ec.message());
+                    return;
+                }
+                if (want_zerocopy_ && !zc_.enable(socket_.native_handle())) {
+                    g_logger.log("MSG_ZEROCOPY not supported, stream uses copy send");
+                }
+                do_write();
+                do_read();
+            });
+    }
+
+    void stop() {
+        auto self(shared_from_this());
+        boost::asio::post(socket_.get_executor(), [this, self]() {
+            stopped_ = true;
+            boost::system::error_code ignored_ec;
+            socket_.shutdown(tcp::socket::shutdown_both, ignored_ec);
+            socket_.close(ignored_ec);
+        });
+    }
+
+private:
+    void do_write() {
+        if (stopped_) return;
+        if (zc_.enabled()) {
+            write_zerocopy();
+            return;
+        }
+        auto self(shared_from_this());
+        boost::asio::async_write(socket_, boost::asio::buffer(payload_),
+            [this, self](boost::system::error_code ec, std::size_t length) {
+                if (ec) {
+                    if (!stopped_) g_logger.log("stream writing fail " + ec.message());
+                    return;
+                }
+                stats_.tx += length;
+                do_write();
+            });
+    }
+
+    void write_zerocopy() {
+        int fd = socket_.native_handle();
+        for (;;) {
+            long n = zc_.send(fd, payload_.data() + offset_, payload_.size() - offset_);
+            if (n < 0) break;
+            stats_.tx += static_cast<std::uint64_t>(n);
+            offset_ = (offset_ + static_cast<std::size_t>(n)) % payload_.size();
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            if (!stopped_) g_logger.log(std::string("stream zerocopy send fail ") + std::strerror(errno));
+            return;
+        }
+        zc_.poll_completions(fd);
+        auto self(shared_from_this());
+        socket_.async_wait(tcp::socket::wait_write,
+            [this, self](boost::system::error_code ec) {
+                if (!ec && !stopped_) write_zerocopy();
+            });
+    }
+
+    void do_read() {
+        auto self(shared_from_this());
+        socket_.async_read_some(boost::asio::buffer(reply_),
+            [this, self](boost::system::error_code ec, std::size_t length) {
+                if (ec) {
+                    if (!stopped_) g_logger.log("stream read error " + ec.message());
+                    return;
+                }
+                stats_.rx += length;
+                do_read();
+            });
+    }
+
+    tcp::socket socket_;
+    const std::vector<char>& payload_;
+    std::vector<char> reply_;
+    std::size_t offset_ = 0;
+    StreamStats& stats_;
+    bool stopped_ = false;
+    bool want_zerocopy_;
+    ZeroCopy zc_;
 };
 
+// num_clients suPɦy cfg.seconds AX Gbit/s P CPU-s/GB
+int run_stream(const tcp::resolver::results_type& endpoints, int num_clients, const StreamConfig& cfg) {
+    boost::asio::io_context io;
+    StreamStats stats;
+    std::vector<char> payload(cfg.buffer_size);
+    for (std::size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<char>('a' + i % 26);
+
+    std::vector<std::shared_ptr<StreamClient>> clients;
+    for (int i = 0; i < num_clients; ++i) {
+        auto client = std::make_shared<StreamClient>(io, payload, cfg, stats);
+        client->start(endpoints);
+        clients.push_back(client);
+    }
+
+    auto wall_begin = std::chrono::steady_clock::now();
+    double cpu_begin = process_cpu_seconds();
+    boost::asio::steady_timer timer(io, std::chrono::seconds(cfg.seconds));
+    timer.async_wait([&](boost::system::error_code) {
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_begin).count();
+        std::cout << "stream " << num_clients << " connections, " << cfg.buffer_size / 1024 << " KB buffers"
+            << (cfg.zerocopy ? ", zerocopy" : "") << ": "
+            << format_throughput(stats.rx.load(), stats.tx.load(), wall, process_cpu_seconds() - cpu_begin) << std::endl;
+        for (auto& c : clients) c->stop();
+    });
+
+    int thread_count = std::thread::hardware_concurrency();
+    std::vector<std::thread> threads;
+    for (int a = 0; a < thread_count; ++a) {
+        threads.emplace_back([&io]() {io.run();});
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return 0;
+}
+
+//  --replay sɭ serverA--speed=2 ⭿tA--speed=max 
+int run_replay(const tcp::resolver::results_type& endpoints, const std::string& path, const std::string& speed_opt) {
+    try {
+        CaptureFile capture(path);
+        double speed = speed_opt == "max" ? 0 : std::stod(speed_opt);
+
+        ReplayTransport<tcp::socket> transport;
+        transport.make = [](const ReplayStrand& strand) { return std::make_unique<tcp::socket>(strand); };
+        transport.connect = [](tcp::socket& socket, const tcp::resolver::results_type& endpoints,
+            std::function<void(boost::system::error_code)> done) {
+                boost::asio::async_connect(socket, endpoints,
+                    [done](boost::system::error_code ec, tcp::endpoint) { done(ec); });
+            };
+        transport.close = [](tcp::socket& socket, std::function<void()> done) {
+            boost::system::error_code ignored_ec;
+            socket.shutdown(tcp::socket::shutdown_both, ignored_ec);
+            socket.close(ignored_ec);
+            done();
+        };
+
+        boost::asio::io_context io;
+        auto guard = boost::asio::make_work_guard(io);
+        int thread_count = std::thread::hardware_concurrency();
+        std::vector<std::thread> threads;
+        for (int a = 0; a < thread_count; ++a) {
+            threads.emplace_back([&io]() {io.run();});
+        }
+
+        std::vector<char> payload(64 * 1024, 'R');
+        ReplayStats stats;
+        auto begin = std::chrono::steady_clock::now();
+        replay_capture(capture, io, endpoints, transport, payload, speed, stats);
+        guard.reset();
+        for (auto& t : threads) {
+            t.join();
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << replay_report(stats, wall) << std::endl;
+    }
+    catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
 
 int main(int argc, char* argv[]) {
-    if (argc != 6) {
-        std::cerr << "Usage: client <host> <port> <num_connections/t><multi/t><write->read/t>\n";
+    if (argc < 6) {
+        std::cerr << "Usage: client <host> <port> <num_connections/t><multi/t><write->read/t>"
+            " [--mode=stream [--buffer-kb=256] [--seconds=10] [--zerocopy]] [--replay=<file> [--speed=1|max]]"
+            " [--warmup=s] [--measure=s] [--cooldown=s] [--round-ms=10]"
+            " [--compress=lz4|none] [--compress-min=256] [--payload-bytes=64] [--seed=1] [--capture=<file>]\n";
         return 1;
     }
     std::string host = argv[1];
@@ -134,31 +436,59 @@ int main(int argc, char* argv[]) {
     int num_clients = std::stoi(argv[3]);
     int num_limit = std::stoi(argv[4]);
     int num_trade = std::stoi(argv[5]);
+    Options opt(argc, argv, 6);
+    StreamConfig stream = stream_config_from(opt);
 
     boost::asio::io_context io;
     tcp::resolver resolver(io);
     auto endpoints = resolver.resolve(host, port);
+    if (stream.enabled) {
+        return run_stream(endpoints, num_clients, stream);
+    }
+    if (opt.has("replay")) {
+        return run_replay(endpoints, opt.get("replay"), opt.get("speed", "1"));
+    }
+    g_compress = compress_config_from(opt, false);
+    g_payload = payload_pool_from(opt);
+    try {
+        if (opt.has("capture")) g_capture = std::make_unique<CaptureWriter>(opt.get("capture"));
+    }
+    catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+    g_run.configure(opt);
+    g_run.start(io);
+    const int round_ms = static_cast<int>(opt.get_int("round-ms", 10));
+
+    // hu{] io_contextAקKu{dFҦ round @ΦP@ threadAεW@
+    auto guard = boost::asio::make_work_guard(io);
+    int thread_count = std::thread::hardware_concurrency();
+    std::vector<std::thread> threads;
+    for (int a = 0; a < thread_count; ++a) {
+        threads.emplace_back([&io]() {io.run();});
+    }
+
     int num = 0;
     for (int multi = 0; multi < num_limit; ++multi) {
-        std::vector<std::shared_ptr<ClientSession>> clients;
         for (int i = 0; i < num_clients; ++i) {
             std::string date = getCurrentSystemTime();
-            std::string msg = "Client " + std::to_string(num+1) + " Time(MM/SS) " + date +" ";
-            auto client = std::make_shared<ClientSession>(io, msg, num_trade);          
-            client->start(endpoints);
-            clients.push_back(client);
+            std::string label = "Client " + std::to_string(num+1) + " Time(MM/SS) " + date +" ";
+            boost::asio::post(io, [&io, &endpoints, label, num, num_trade]() {
+                auto client = std::make_shared<ClientSession>(io, label, static_cast<std::uint32_t>(num), num_trade);
+                client->start(endpoints);
+                });
             num=num + 1 ;
         }
-        // hu{] io_contextAקKu{d
-        int thread_count = std::thread::hardware_concurrency();
-        std::vector<std::thread> threads;
-
-        for (int a = 0; a < thread_count; ++a) {
-            threads.emplace_back([&io]() {io.run();});
-        }
-        for (auto& t : threads) {
-            t.join();
-        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(round_ms));
     }
 
+    // Ҧ session Pq timer  io.run() ۵M^
+    guard.reset();
+    for (auto& t : threads) {
+        t.join();
+    }
+    g_run.finish();
+    if (g_capture) g_capture->close();
+    return g_run.succeeded() ? 0 : 1;   // suѩΨST
 }
\ No newline at end of file
@@ -5,15 +5,23 @@
 #include <vector>
 #include <thread>
 #include <chrono>
+#include <cstring>
 #include "writelog.h"
-#include <atomic>
+#include "tls_config.h"
+#include "replay.h"
+#include "run_controller.h"
+#include "compress.h"
+#include "payload.h"
 
-std::atomic<int> counter = 0;
 using boost::asio::ip::tcp;
 namespace ssl = boost::asio::ssl;
 namespace chrono = boost::asio::chrono;
 
 Logger g_logger("checkclient");
+RunController g_run;
+CompressConfig g_compress; // --compress  handshake ӡAChT frame
+std::unique_ptr<const PayloadPool> g_payload; // --payload-bytes / --seedAҦsu@
+std::unique_ptr<CaptureWriter> g_capture;     // --capture ɿUCsueXTjpPɶAi --replay
 
 std::string getCurrentSystemTime() {
     auto tt = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -25,13 +33,23 @@ std::string getCurrentSystemTime() {
 
 class ClientSession : public std::enable_shared_from_this<ClientSession> {
 public:
-    ClientSession(boost::asio::io_context& io, ssl::context& ssl_ctx,
-        std::string msg, int repeat_count, int interval_ms)
+    // label uΦb logFeXeO g_payload  (id, ĴX) Mw@q
+    // tls / hostG --ca  handshake nҪDW
+    ClientSession(boost::asio::io_context& io, ssl::context& ssl_ctx, const TlsConfig& tls, const std::string& host,
+        std::string label, std::uint32_t id, int repeat_count, int interval_ms)
         : socket_(io, ssl_ctx),
-        message_(std::move(msg)),
+        tls_(tls),
+        host_(host),
+        label_(std::move(label)),
+        id_(id),
+        rx_(payload_rx_size(g_payload->length())),
         timer_(io),
         remaining_(repeat_count),
-        interval_ms_(interval_ms) {}
+        interval_ms_(interval_ms),
+        frames_(socket_) {}
+    ~ClientSession() {
+        if (captured_) g_capture->close_connection(capture_id_);
+    }
 
     void start(const tcp::resolver::results_type& endpoints) {
         auto self = shared_from_this();
@@ -39,23 +57,49 @@ public:
             socket_.lowest_layer(), endpoints,
             [this, self, endpoints](boost::system::error_code ec, tcp::endpoint) {
                 if (!ec) {
+                    boost::system::error_code vec = set_client_verify_host(socket_, tls_, host_);
+                    if (vec) {
+                        g_logger.log("Verify host " + host_ + " failed: " + vec.message() + " | " + label_);
+                        g_run.connection_failed();
+                        close_TCP();
+                        return;
+                    }
                     //  TCP connectA}l TLS handshake
                     socket_.async_handshake(ssl::stream_base::client,
                         [this, self](boost::system::error_code ec2) {
-                            if (!ec2) {
-                                counter++;
+                            if (!ec2 && g_capture) {
+                                capture_id_ = g_capture->open_connection();
+                                captured_ = true;
+                            }
+                            if (!ec2 && g_compress.enabled) {
+                                frames_.async_client_hello(g_compress, [this, self](boost::system::error_code ec3) {
+                                    if (!ec3) {
+                                        framed_ = true;
+                                        do_one_cycle();
+                                    }
+                                    else {
+                                        g_logger.log("Compress hello failed: " + ec3.message());
+                                        g_run.connection_failed();
+                                        close();
+                                    }
+                                });
+                            }
+                            else if (!ec2) {
                                 do_one_cycle();
                             }
                             else {
                                 g_logger.log("TLS handshake failed: " + ec2.message());
+                                g_run.connection_failed();
                                 close();
                             }
                         });
                 }
                 else {
                     auto self2 = shared_from_this();
-                    g_logger.log("TCP connect failed: " + ec.message() + " | " + message_);
-                    schedule_reconnect(endpoints);
+                    g_logger.log("TCP connect failed: " + ec.message() + " | " + label_);
+                    g_run.connection_failed();
+                    // TwƼҦSɶAsWNoAM io û|
+                    if (g_run.timed()) schedule_reconnect(endpoints);
                 }
             });
 
@@ -64,63 +108,99 @@ public:
 private:
     void do_one_cycle() {
         if (remaining_ < 0) {
-            g_logger.log("Done cycles, closing: " + message_);
+            g_logger.log("Done cycles, closing: " + label_);
             close();
             return;
         }
         else if (remaining_ == 0) remaining_ = 100; // remaining== 0 = 100
 
         auto self = shared_from_this();
-        boost::asio::async_write(
-            socket_, boost::asio::buffer(message_),
-            [this, self](boost::system::error_code ec, std::size_t) {
+        sent_at_ = std::chrono::steady_clock::now();
+        const std::size_t offset = g_payload->offset(id_, seq_++);
+        const char* data = g_payload->data(offset);
+        verifier_.begin(*g_payload, offset);
+        if (captured_) g_capture->data(capture_id_, g_payload->length());
+        auto on_written = [this, self](boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                g_logger.log("Write error: " + ec.message() + " | " + label_);
+                close();
+                return;
+            }
+            if (framed_) async_read_frame();
+            else async_read_reply();
+        };
+        if (framed_) frames_.async_send(data, g_payload->length(), on_written);
+        else boost::asio::async_write(socket_, boost::asio::buffer(data, g_payload->length()), on_written);
+    }
+
+    // jT|h frameAC frame NFwire = ohثe쪺uW bytes
+    void async_read_frame(std::size_t wire = 0) {
+        auto self = shared_from_this();
+        frames_.async_receive(
+            [this, self, wire](boost::system::error_code ec, const char* data, std::size_t n, std::size_t frame_wire, bool more) {
                 if (ec) {
-                    g_logger.log("Write error: " + ec.message() + " | " + message_);
+                    g_logger.log("Read error: " + ec.message() + " | " + label_);
                     close();
                     return;
                 }
-                async_read_reply();
+                verifier_.update(data, n);
+                if (more) async_read_frame(wire + frame_wire);
+                else check_reply(wire + frame_wire);
             });
     }
 
+    // jTqŪi rx_ACqŪNArx_ jpTw
     void async_read_reply() {
         auto self = shared_from_this();
+        std::size_t n = std::min(rx_.size(), verifier_.remaining());
         boost::asio::async_read(
-            socket_, boost::asio::buffer(reply_, message_.size()),
+            socket_, boost::asio::buffer(rx_.data(), n),
             [this, self](boost::system::error_code ec, std::size_t n) {
                 if (ec) {
-                    g_logger.log("Read error: " + ec.message() + " | " + message_);
+                    g_logger.log("Read error: " + ec.message() + " | " + label_);
                     close();
                     return;
                 }
+                verifier_.update(rx_.data(), n);
+                if (verifier_.done()) check_reply(g_payload->length());
+                else async_read_reply();
+            });
+    }
 
-                std::string r(reply_, n);
-                if (r == message_) {
-                    g_logger.log("Echo OK | " + message_ + " | T=" + getCurrentSystemTime());
-                }
-                else {
-                    g_logger.log("Echo mismatch | expect='" + message_ + "' got='" + r + "'");
-                }
+    void check_reply(std::size_t wire) {
+        if (verifier_.done() && verifier_.ok()) {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent_at_);
+            g_run.record(static_cast<std::uint64_t>(us.count()), g_payload->length(), wire);
+            g_logger.log("Echo OK | " + label_ + " | T=" + getCurrentSystemTime());
+        }
+        else {
+            g_run.error();
+            g_logger.log("Echo mismatch | " + label_ + " | at byte " + std::to_string(verifier_.error_offset())
+                + " of " + std::to_string(g_payload->length()));
+        }
+        next_cycle();
+    }
 
-                --remaining_;
-                if (remaining_ > 0) {
-                    auto self2 = shared_from_this();
-                    timer_.expires_after(chrono::milliseconds(interval_ms_));
-                    timer_.async_wait([this, self2](boost::system::error_code tec) {
-                        if (!tec) {
-                            do_one_cycle();
-                        }
-                        else if (tec != boost::asio::error::operation_aborted) {
-                            g_logger.log("Timer error: " + tec.message() + " | " + message_);
-                            close();
-                        }
-                        });
+    void next_cycle() {
+        // pɼҦ cool-down A_h]Tw
+        --remaining_;
+        if (g_run.timed() ? !g_run.finished() : remaining_ > 0) {
+            auto self = shared_from_this();
+            timer_.expires_after(chrono::milliseconds(interval_ms_));
+            timer_.async_wait([this, self](boost::system::error_code tec) {
+                if (!tec) {
+                    do_one_cycle();
                 }
-                else {
-                    //g_logger.log(message_+" Last connection, closing.");
+                else if (tec != boost::asio::error::operation_aborted) {
+                    g_logger.log("Timer error: " + tec.message() + " | " + label_);
                     close();
                 }
-            });
+                });
+        }
+        else {
+            //g_logger.log(label_+" Last connection, closing.");
+            close();
+        }
     }
 
     void close() {
@@ -136,7 +216,7 @@ private:
                     });
             }
             else {
-                g_logger.log("close error: " + tec.message() + " | " + message_);
+                g_logger.log("close error: " + tec.message() + " | " + label_);
             }
             });
 
@@ -148,16 +228,14 @@ private:
         boost::system::error_code ig;
         socket_.lowest_layer().shutdown(tcp::socket::shutdown_both, ig);
         socket_.lowest_layer().close(ig);
-        counter--;
-        //g_logger.log("closed. counter=" + std::to_string(counter.load()));
     }
 
     void schedule_reconnect(const tcp::resolver::results_type& endpoints) {
         auto self(shared_from_this());
         timer_.expires_after(chrono::seconds(10));  //  10 
         timer_.async_wait([this, self, endpoints](boost::system::error_code ec) {
-            if (!ec) {
-                g_logger.log("Retrying connect after 10s: " + message_);
+            if (!ec && !g_run.finished()) {
+                g_logger.log("Retrying connect after 10s: " + label_);
                 socket_.lowest_layer().close();              // TO socket Mb
                 socket_.lowest_layer().open(tcp::v4());      // s}
                 start(endpoints);                            // AIs@ start()
@@ -166,16 +244,29 @@ private:
     }
 
     ssl::stream<tcp::socket> socket_;
-    std::string message_;
-    char reply_[1024];
+    const TlsConfig& tls_;
+    std::string host_;
+    std::string label_;
+    std::uint32_t id_;
+    std::uint32_t seq_ = 0;
+    std::vector<char> rx_;
+    PayloadVerifier verifier_;
     boost::asio::steady_timer timer_;
     int remaining_;
     int interval_ms_;
+    std::chrono::steady_clock::time_point sent_at_;
+    FrameChannel<ssl::stream<tcp::socket>> frames_;
+    bool framed_ = false;
+    std::uint32_t capture_id_ = 0;
+    bool captured_ = false;
 };
 
 int main(int argc, char* argv[]) {
-    if (argc != 7) {
-        std::cerr << "Usage: client <host> <port> <num_connections_per_tick> <ticks> <write_read_cycles> <interval_ms>\n";
+    if (argc < 7) {
+        std::cerr << "Usage: client <host> <port> <num_connections_per_tick> <ticks> <write_read_cycles> <interval_ms>"
+            " [--ciphersuites=..] [--groups=..] [--cert=ecdsa|rsa] [--ca=..] [--provider=..] [--engine=..]"
+            " [--replay=<file> [--speed=1|max]] [--warmup=s] [--measure=s] [--cooldown=s]"
+            " [--compress=lz4|none] [--compress-min=256] [--payload-bytes=64] [--seed=1] [--capture=<file>]\n";
         return 1;
     }
 
@@ -185,13 +276,22 @@ int main(int argc, char* argv[]) {
     const int ticks = std::stoi(argv[4]);
     const int cycles_per_conn = std::stoi(argv[5]);
     const int interval_ms = std::stoi(argv[6]);
+    Options opt(argc, argv, 7);
+    TlsConfig tls = tls_config_from(opt);
 
     boost::asio::io_context io;
 
     // TLS context (client)
     ssl::context ssl_ctx(ssl::context::tlsv13_client);
-    ssl_ctx.set_default_verify_paths();
-    ssl_ctx.set_verify_mode(ssl::verify_none); // եΡAҭn verify_peer
+    try {
+        load_crypto_backend(tls);
+        ssl_ctx.set_default_verify_paths();
+        apply_client_tls_config(ssl_ctx, tls);
+    }
+    catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
 
     auto guard = boost::asio::make_work_guard(io);
 
@@ -208,27 +308,87 @@ int main(int argc, char* argv[]) {
     tcp::resolver resolver(io);
     auto endpoints = resolver.resolve(host, port);
 
+    // ̿sɭANUXT
+    if (opt.has("replay")) {
+        try {
+            CaptureFile capture(opt.get("replay"));
+            std::string speed_opt = opt.get("speed", "1");
+            double speed = speed_opt == "max" ? 0 : std::stod(speed_opt);
+
+            using SslStream = ssl::stream<tcp::socket>;
+            ReplayTransport<SslStream> transport;
+            transport.make = [&ssl_ctx](const ReplayStrand& strand) { return std::make_unique<SslStream>(strand, ssl_ctx); };
+            transport.connect = [&tls, &host](SslStream& stream, const tcp::resolver::results_type& endpoints,
+                std::function<void(boost::system::error_code)> done) {
+                    boost::asio::async_connect(stream.lowest_layer(), endpoints,
+                        [&stream, &tls, &host, done](boost::system::error_code ec, tcp::endpoint) {
+                            if (!ec) ec = set_client_verify_host(stream, tls, host);
+                            if (ec) {
+                                done(ec);
+                                return;
+                            }
+                            stream.async_handshake(ssl::stream_base::client, done);
+                        });
+                };
+            transport.close = [](SslStream& stream, std::function<void()> done) {
+                stream.async_shutdown([&stream, done](const boost::system::error_code&) {
+                    boost::system::error_code ig;
+                    stream.lowest_layer().close(ig);
+                    done();
+                    });
+            };
+
+            std::vector<char> payload(64 * 1024, 'R');
+            ReplayStats stats;
+            auto begin = std::chrono::steady_clock::now();
+            replay_capture(capture, io, endpoints, transport, payload, speed, stats);
+            guard.reset();
+            for (auto& th : threads) th.join();
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            std::cout << replay_report(stats, wall) << std::endl;
+        }
+        catch (std::exception& e) {
+            std::cerr << "Exception: " << e.what() << "\n";
+            guard.reset();
+            for (auto& th : threads) if (th.joinable()) th.join();
+            return 1;
+        }
+        return 0;
+    }
+
+    g_compress = compress_config_from(opt, false);
+    g_payload = payload_pool_from(opt);
+    try {
+        if (opt.has("capture")) g_capture = std::make_unique<CaptureWriter>(opt.get("capture"));
+    }
+    catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        guard.reset();
+        for (auto& th : threads) th.join();
+        return 1;
+    }
+    g_run.configure(opt);
+    g_run.start(io);
+
     int global_id = 0;
     for (int t = 0; t < ticks; ++t) {
         for (int i = 0; i < per_tick; ++i) {
             const int id = ++global_id;
             const std::string date = getCurrentSystemTime();
-            const std::string msg = "Client " + std::to_string(id) + " Time(MM/SS) " + date + " ";
+            const std::string label = "Client " + std::to_string(id) + " Time(MM/SS) " + date + " ";
 
-            boost::asio::post(io, [&, msg]() {
-                auto s = std::make_shared<ClientSession>(io, ssl_ctx, msg, cycles_per_conn, interval_ms);
+            boost::asio::post(io, [&, label, id]() {
+                auto s = std::make_shared<ClientSession>(io, ssl_ctx, tls, host, label, static_cast<std::uint32_t>(id), cycles_per_conn, interval_ms);
                 s->start(endpoints);
                 });
         }
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
-    while (1) {
-        if (counter.load() == 0) {
-            guard.reset();
-            break;
-        }
-    }
+    // AssuAҦ session Pq timer  io.run() ۵M^
+    guard.reset();
     for (auto& th : threads) th.join();
+    g_run.finish();
+    if (g_capture) g_capture->close();
 
-    return 0;
+    return g_run.succeeded() ? 0 : 1;   // suѩΨST
 }
\ No newline at end of file
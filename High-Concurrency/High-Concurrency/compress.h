@@ -0,0 +1,239 @@
+﻿#pragma once
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "lz4_block.h"
+#include "options.h"
+
+// 每則訊息各自壓縮 (--compress)，連線建立後協商
+//
+// 協商：client 先送 4 bytes hello "HCZ" + 想用的方式，server 回 "HCZ" + 決定的方式。
+//      server 第一次收到的資料不是 hello 就整段當一般 echo，舊 client 不受影響
+//      (只有開頭剛好是 "HCZ" 的一部分且不滿 4 bytes 時會等下一段資料)。
+//      client 收到 server 的 hello 之前不會送 frame。
+// 協商後每則訊息拆成一或多個 frame，每個 frame 原文最多 64KB：8 bytes header + payload
+//      header = [payload 長度 | 0x80000000 表示有壓縮][原始長度 | 0x80000000 表示訊息還沒結束]，little endian
+//      小於門檻 (--compress-min) 或壓不小的 frame 直接送原文。
+//      收發 buffer 只需要一個 frame 大，跟訊息多大無關。
+
+enum class Compression : std::uint8_t { none = 0, lz4 = 1 };
+
+struct CompressConfig {
+    bool enabled = false;                        // client：有給 --compress 才送 hello
+    Compression algo = Compression::none;        // client：要求的方式；server：允許的方式
+    std::size_t threshold = 256;                 // --compress-min
+};
+
+// client：--compress=lz4|none；server：預設允許 lz4，--compress=none 拒絕
+inline CompressConfig compress_config_from(const Options& opt, bool server) {
+    CompressConfig cfg;
+    cfg.enabled = opt.has("compress");
+    std::string name = opt.get("compress", server ? "lz4" : "none");
+    cfg.algo = name == "lz4" ? Compression::lz4 : Compression::none;
+    cfg.threshold = static_cast<std::size_t>(opt.get_int("compress-min", 256));
+    return cfg;
+}
+
+inline const char* compression_name(Compression c) { return c == Compression::lz4 ? "lz4" : "none"; }
+
+const std::size_t hello_size = 4;
+const std::size_t frame_header_size = 8;
+const std::size_t frame_chunk_size = 64 * 1024;
+
+inline bool is_hello(const char* p) { return p[0] == 'H' && p[1] == 'C' && p[2] == 'Z'; }
+
+// 收到的前 n (< hello_size) bytes 還可能是被拆開的 hello
+inline bool is_hello_prefix(const char* p, std::size_t n) {
+    static const char magic[] = "HCZ";
+    return std::memcmp(p, magic, n < 3 ? n : 3) == 0;
+}
+
+inline void make_hello(char* p, Compression c) {
+    p[0] = 'H';
+    p[1] = 'C';
+    p[2] = 'Z';
+    p[3] = static_cast<char>(c);
+}
+
+inline void put_u32(char* p, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+inline std::uint32_t get_u32(const char* p) {
+    std::uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+struct FrameHeader {
+    std::size_t wire;      // payload 在線上的長度
+    std::size_t raw;       // 解壓後長度
+    bool compressed;
+    bool more;             // 同一則訊息後面還有 frame
+};
+
+inline FrameHeader parse_frame_header(const char* p) {
+    std::uint32_t w = get_u32(p);
+    std::uint32_t r = get_u32(p + 4);
+    return { w & 0x7fffffffu, r & 0x7fffffffu, (w & 0x80000000u) != 0, (r & 0x80000000u) != 0 };
+}
+
+inline void make_frame_header(char* p, std::size_t wire, bool compressed, std::size_t raw, bool more) {
+    put_u32(p, static_cast<std::uint32_t>(wire) | (compressed ? 0x80000000u : 0));
+    put_u32(p + 4, static_cast<std::uint32_t>(raw) | (more ? 0x80000000u : 0));
+}
+
+// 每條 thread 一份的壓縮 context 與解壓 buffer，只會變大，不會每則訊息配置
+struct CompressScratch {
+    Lz4Context lz4;
+    std::vector<char> raw;
+};
+
+inline CompressScratch& compress_scratch() {
+    thread_local CompressScratch scratch;
+    return scratch;
+}
+
+// 壓縮一個 frame 的原文到 out (out 只會變大，最多一個 frame)，回傳壓縮後大小；
+// 不壓縮 (門檻以下或壓不小) 時回傳 0，直接送原文
+inline std::size_t compress_frame(const char* data, std::size_t n, Compression algo, std::size_t threshold, std::vector<char>& out) {
+    if (algo != Compression::lz4 || n == 0 || n < threshold) return 0;
+    if (out.size() < n) out.resize(n);
+    // cap = n - 1：壓不小就不用
+    return lz4_compress(data, n, out.data(), n - 1, compress_scratch().lz4);
+}
+
+// 回傳原文；有壓縮時放在 thread 的 scratch，同一條 thread 下一次 decode 前有效。損毀時回傳 nullptr
+inline const char* decode_frame(const FrameHeader& h, const char* payload) {
+    if (!h.compressed) return h.raw == h.wire ? payload : nullptr;
+    std::vector<char>& raw = compress_scratch().raw;
+    if (raw.size() < h.raw) raw.resize(h.raw);
+    long n = lz4_decompress(payload, h.wire, raw.data(), h.raw);
+    return n == static_cast<long>(h.raw) ? raw.data() : nullptr;
+}
+
+// 一條連線的 frame 收發，Stream = tcp::socket 或 ssl::stream<tcp::socket>
+// 送出與接收各用自己的 buffer，可以同時進行 (同一方向一次只能有一個操作)；
+// buffer 最多一個 frame 大，跟著連線重複使用。沒壓縮的 frame 直接從呼叫端的資料送出，不複製
+template <class Stream>
+class FrameChannel {
+public:
+    explicit FrameChannel(Stream& stream) : stream_(stream) {}
+
+    Compression algo() const { return algo_; }
+
+    // client：送 hello，等 server 回覆決定的方式。handler(ec)
+    template <class Handler>
+    void async_client_hello(const CompressConfig& cfg, Handler handler) {
+        threshold_ = cfg.threshold;
+        make_hello(hello_, cfg.algo);
+        boost::asio::async_write(stream_, boost::asio::buffer(hello_, hello_size),
+            [this, handler](boost::system::error_code ec, std::size_t) mutable {
+                if (ec) {
+                    handler(ec);
+                    return;
+                }
+                boost::asio::async_read(stream_, boost::asio::buffer(hello_, hello_size),
+                    [this, handler](boost::system::error_code ec, std::size_t) mutable {
+                        if (!ec && !is_hello(hello_)) ec = boost::asio::error::invalid_argument;
+                        if (!ec) algo_ = static_cast<Compression>(hello_[3]);
+                        handler(ec);
+                    });
+            });
+    }
+
+    // server：hello 是已經讀到的前 4 bytes，client 要求的方式 server 有允許才使用。handler(ec)
+    template <class Handler>
+    void async_server_hello(const char* hello, const CompressConfig& cfg, Handler handler) {
+        threshold_ = cfg.threshold;
+        Compression want = static_cast<Compression>(hello[3]);
+        algo_ = want == Compression::lz4 && cfg.algo == Compression::lz4 ? Compression::lz4 : Compression::none;
+        make_hello(hello_, algo_);
+        boost::asio::async_write(stream_, boost::asio::buffer(hello_, hello_size),
+            [handler](boost::system::error_code ec, std::size_t) mutable { handler(ec); });
+    }
+
+    // 送出整則訊息，依 frame_chunk_size 拆成多個 frame；data 要保持有效到 handler 被呼叫。
+    // handler(ec, 線上 bytes)
+    template <class Handler>
+    void async_send(const char* data, std::size_t n, Handler handler) {
+        send_rest(data, n, 0, std::move(handler));
+    }
+
+    // 送出一個 frame (n <= frame_chunk_size)，more = 同一則訊息後面還有。
+    // data 要保持有效到 handler 被呼叫 (async_receive 給的 data 可以直接回送)。handler(ec, 線上 bytes)
+    template <class Handler>
+    void async_send_frame(const char* data, std::size_t n, bool more, Handler handler) {
+        std::size_t wire = compress_frame(data, n, algo_, threshold_, out_);
+        bool compressed = wire > 0;
+        if (!compressed) {
+            wire = n;
+            // 剛解壓在 thread scratch 的資料 (server echo) 要先複製，write 完成前這條 thread 可能解壓別的連線
+            const std::vector<char>& raw = compress_scratch().raw;
+            if (n > 0 && data >= raw.data() && data < raw.data() + raw.size()) {
+                if (out_.size() < n) out_.resize(n);
+                std::memcpy(out_.data(), data, n);
+                data = out_.data();
+            }
+        }
+        make_frame_header(header_out_, wire, compressed, n, more);
+        std::array<boost::asio::const_buffer, 2> bufs = {
+            boost::asio::buffer(header_out_, frame_header_size),
+            boost::asio::buffer(compressed ? out_.data() : data, wire) };
+        boost::asio::async_write(stream_, bufs,
+            [handler](boost::system::error_code ec, std::size_t length) mutable { handler(ec, length); });
+    }
+
+    // 收一個 frame。handler(ec, data, 原始長度, 線上 bytes, more)，data 只在 handler 內有效；
+    // more = true 時再呼叫一次 async_receive 收同一則訊息的下一段
+    template <class Handler>
+    void async_receive(Handler handler) {
+        boost::asio::async_read(stream_, boost::asio::buffer(header_in_, frame_header_size),
+            [this, handler](boost::system::error_code ec, std::size_t) mutable {
+                if (ec) {
+                    handler(ec, nullptr, 0, 0, false);
+                    return;
+                }
+                FrameHeader h = parse_frame_header(header_in_);
+                if (h.raw > frame_chunk_size || h.wire > (h.compressed ? lz4_bound(h.raw) : h.raw)) {
+                    handler(boost::asio::error::message_size, nullptr, 0, 0, false);
+                    return;
+                }
+                if (in_.size() < h.wire) in_.resize(h.wire);
+                boost::asio::async_read(stream_, boost::asio::buffer(in_.data(), h.wire),
+                    [this, h, handler](boost::system::error_code ec, std::size_t) mutable {
+                        const char* data = ec ? nullptr : decode_frame(h, in_.data());
+                        if (!ec && data == nullptr) ec = boost::asio::error::invalid_argument;
+                        handler(ec, data, data ? h.raw : 0, frame_header_size + h.wire, h.more);
+                    });
+            });
+    }
+
+private:
+    template <class Handler>
+    void send_rest(const char* data, std::size_t n, std::size_t wire, Handler handler) {
+        std::size_t part = std::min(n, frame_chunk_size);
+        async_send_frame(data, part, part < n,
+            [this, data, n, part, wire, handler](boost::system::error_code ec, std::size_t length) mutable {
+                if (ec || part == n) {
+                    handler(ec, wire + length);
+                    return;
+                }
+                send_rest(data + part, n - part, wire + length, std::move(handler));
+            });
+    }
+
+    Stream& stream_;
+    Compression algo_ = Compression::none;
+    std::size_t threshold_ = 256;
+    char hello_[hello_size];
+    char header_in_[frame_header_size];
+    char header_out_[frame_header_size];
+    std::vector<char> in_;
+    std::vector<char> out_;
+};
@@ -0,0 +1,154 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// LZ4 block 格式 (與 LZ4_compress_default / LZ4_decompress_safe 相容) 的精簡實作
+// 只做單一 block、greedy 比對，給每則訊息的壓縮用
+
+// 壓縮用的 hash table，每條 thread 一份重複使用
+// base 每次壓縮往後推，舊的位置自動落在 64KB 視窗外，不用每次清表
+struct Lz4Context {
+    enum { hash_log = 12 };
+    std::uint32_t table[1 << hash_log] = {};
+    std::uint32_t base = 0;
+};
+
+inline std::size_t lz4_bound(std::size_t n) { return n + n / 255 + 16; }
+
+namespace lz4_detail {
+
+inline std::uint32_t read32(const std::uint8_t* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline std::uint32_t hash(std::uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - Lz4Context::hash_log);
+}
+
+// 長度 >= 15 時的延伸位元組
+inline std::uint8_t* put_length(std::uint8_t* op, std::size_t len) {
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = static_cast<std::uint8_t>(len);
+    return op;
+}
+
+inline bool get_length(const std::uint8_t*& ip, const std::uint8_t* iend, std::size_t& len) {
+    std::uint8_t b;
+    do {
+        if (ip >= iend) return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+} // namespace lz4_detail
+
+// 回傳壓縮後大小，dst 放不下 (cap 不足) 時回傳 0
+inline std::size_t lz4_compress(const char* src_, std::size_t n, char* dst_, std::size_t cap, Lz4Context& ctx) {
+    using namespace lz4_detail;
+    const std::size_t min_match = 4, mflimit = 12, last_literals = 5, max_offset = 65535;
+    const std::uint8_t* src = reinterpret_cast<const std::uint8_t*>(src_);
+    std::uint8_t* op = reinterpret_cast<std::uint8_t*>(dst_);
+    std::uint8_t* const oend = op + cap;
+
+    if (n > 0x7e000000u) return 0;
+    if (ctx.base > 0x40000000u) {
+        std::memset(ctx.table, 0, sizeof(ctx.table));
+        ctx.base = 0;
+    }
+    const std::uint32_t base = ctx.base + 1; // table 裡的 0 代表空
+    ctx.base = base + static_cast<std::uint32_t>(n) + static_cast<std::uint32_t>(max_offset);
+
+    std::size_t anchor = 0;
+    if (n >= mflimit + 1) {
+        const std::size_t limit = n - mflimit;
+        std::size_t ip = 0;
+        while (ip < limit) {
+            std::uint32_t seq = read32(src + ip);
+            std::uint32_t h = hash(seq);
+            std::uint32_t entry = ctx.table[h];
+            ctx.table[h] = static_cast<std::uint32_t>(ip) + base;
+            std::size_t cand = entry - base;
+            if (entry < base || cand >= ip || ip - cand > max_offset || read32(src + cand) != seq) {
+                ip += 1 + ((ip - anchor) >> 6); // 越久沒找到跳越快
+                continue;
+            }
+            while (ip > anchor && cand > 0 && src[ip - 1] == src[cand - 1]) {
+                --ip;
+                --cand;
+            }
+            std::size_t mlen = min_match;
+            const std::size_t max_len = n - last_literals - ip;
+            while (mlen < max_len && src[ip + mlen] == src[cand + mlen]) ++mlen;
+
+            const std::size_t lit = ip - anchor;
+            if (static_cast<std::size_t>(oend - op) < 1 + lit / 255 + 1 + lit + 2 + (mlen - min_match) / 255 + 1) return 0;
+            std::uint8_t* token = op++;
+            *token = static_cast<std::uint8_t>((lit >= 15 ? 15 : lit) << 4);
+            if (lit >= 15) op = put_length(op, lit - 15);
+            std::memcpy(op, src + anchor, lit);
+            op += lit;
+            const std::size_t offset = ip - cand;
+            *op++ = static_cast<std::uint8_t>(offset);
+            *op++ = static_cast<std::uint8_t>(offset >> 8);
+            const std::size_t ml = mlen - min_match;
+            *token |= static_cast<std::uint8_t>(ml >= 15 ? 15 : ml);
+            if (ml >= 15) op = put_length(op, ml - 15);
+
+            ip += mlen;
+            anchor = ip;
+            if (ip - 2 < limit) ctx.table[hash(read32(src + ip - 2))] = static_cast<std::uint32_t>(ip - 2) + base;
+        }
+    }
+
+    const std::size_t lit = n - anchor;
+    if (static_cast<std::size_t>(oend - op) < 1 + lit / 255 + 1 + lit) return 0;
+    *op++ = static_cast<std::uint8_t>((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) op = put_length(op, lit - 15);
+    if (lit > 0) std::memcpy(op, src + anchor, lit);
+    op += lit;
+    return static_cast<std::size_t>(op - reinterpret_cast<std::uint8_t*>(dst_));
+}
+
+// 回傳解壓後大小，資料損毀或 dst 放不下時回傳 -1
+inline long lz4_decompress(const char* src_, std::size_t n, char* dst_, std::size_t cap) {
+    using namespace lz4_detail;
+    const std::uint8_t* ip = reinterpret_cast<const std::uint8_t*>(src_);
+    const std::uint8_t* const iend = ip + n;
+    std::uint8_t* const dst = reinterpret_cast<std::uint8_t*>(dst_);
+    std::uint8_t* op = dst;
+    std::uint8_t* const oend = dst + cap;
+
+    while (ip < iend) {
+        const std::uint8_t token = *ip++;
+        std::size_t lit = token >> 4;
+        if (lit == 15 && !get_length(ip, iend, lit)) return -1;
+        if (lit > static_cast<std::size_t>(iend - ip) || lit > static_cast<std::size_t>(oend - op)) return -1;
+        std::memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break; // 最後一段只有 literal
+
+        if (iend - ip < 2) return -1;
+        const std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<std::size_t>(op - dst)) return -1;
+        std::size_t mlen = token & 15;
+        if (mlen == 15 && !get_length(ip, iend, mlen)) return -1;
+        mlen += 4;
+        if (mlen > static_cast<std::size_t>(oend - op)) return -1;
+        const std::uint8_t* match = op - offset;
+        if (offset >= mlen) {
+            std::memcpy(op, match, mlen);
+        }
+        else {
+            for (std::size_t i = 0; i < mlen; ++i) op[i] = match[i]; // 重疊時逐 byte 複製
+        }
+        op += mlen;
+    }
+    return static_cast<long>(op - dst);
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <cstdlib>
+#include <map>
+#include <string>
+
+// 解析位置參數之後的 --key=value / --flag 選項
+class Options {
+public:
+    Options(int argc, char* argv[], int first) {
+        for (int i = first; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) != 0) continue;
+            auto eq = arg.find('=');
+            if (eq == std::string::npos) values_[arg.substr(2)] = "1";
+            else values_[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+        }
+    }
+
+    bool has(const std::string& key) const { return values_.count(key) != 0; }
+
+    std::string get(const std::string& key, const std::string& def = "") const {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : it->second;
+    }
+
+    long long get_int(const std::string& key, long long def) const {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : std::atoll(it->second.c_str());
+    }
+
+    double get_double(const std::string& key, double def) const {
+        auto it = values_.find(key);
+        return it == values_.end() ? def : std::atof(it->second.c_str());
+    }
+
+private:
+    std::map<std::string, std::string> values_;
+};
@@ -0,0 +1,241 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define HC_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HC_CRC32C_ARM 1
+#endif
+#include "options.h"
+
+// client 壓測用的訊息內容 (--payload-bytes / --seed)
+// 所有連線共用一塊由 seed 產生的 pool，每則訊息是 pool 中由 (連線, 第幾則) 決定位置的一段，
+// 送出時直接指向 pool，不用每條連線各存一份。同一條連線連續的訊息一定落在不同位置，
+// 晚到或順序錯的 echo 會被驗出來。
+// 收到 echo 時邊收邊驗：整塊 4KB 用 CRC32C 對照 pool 預先算好的值，不足一塊的部分直接比對，
+// CRC 不符時再逐 byte 找出第一個錯誤位置。
+
+namespace crc32c_detail {
+
+inline const std::uint32_t* table() {
+    static const struct Table {
+        std::uint32_t v[256];
+        Table() {
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82f63b78u & (0u - (c & 1)));
+                v[i] = c;
+            }
+        }
+    } t;
+    return t.v;
+}
+
+inline std::uint32_t software(std::uint32_t crc, const unsigned char* p, std::size_t n) {
+    const std::uint32_t* t = table();
+    while (n--) crc = (crc >> 8) ^ t[(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+#if defined(HC_CRC32C_X86)
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+inline std::uint32_t hardware(std::uint32_t crc, const unsigned char* p, std::size_t n) {
+    std::uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        std::uint64_t v;
+        std::memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    std::uint32_t c32 = static_cast<std::uint32_t>(c);
+    for (; n > 0; --n) c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+
+inline bool has_hardware() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#elif defined(HC_CRC32C_ARM)
+inline std::uint32_t hardware(std::uint32_t crc, const unsigned char* p, std::size_t n) {
+    for (; n >= 8; n -= 8, p += 8) {
+        std::uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+    }
+    for (; n > 0; --n) crc = __crc32cb(crc, *p++);
+    return crc;
+}
+
+inline bool has_hardware() { return true; }
+#endif
+
+} // namespace crc32c_detail
+
+// CRC32C (Castagnoli)，有 SSE4.2 / ARMv8 CRC 指令時用硬體計算
+inline std::uint32_t crc32c(const void* data, std::size_t n) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+#if defined(HC_CRC32C_X86) || defined(HC_CRC32C_ARM)
+    static const bool hw = crc32c_detail::has_hardware();
+    if (hw) return ~crc32c_detail::hardware(0xffffffffu, p, n);
+#endif
+    return ~crc32c_detail::software(0xffffffffu, p, n);
+}
+
+class PayloadPool {
+public:
+    static const std::size_t block_size = 4096;
+
+    // length = 每則訊息大小；pool_bytes 越大，不同訊息內容重複的機率越低
+    PayloadPool(std::uint64_t seed, std::size_t length, std::size_t pool_bytes = 1 << 20)
+        : seed_(seed), length_(length), blocks_(std::max<std::size_t>(2, (pool_bytes + block_size - 1) / block_size)) {
+        // 與 blocks_ 互質的步長：同一條連線每 blocks_ 則之內不會重複位置
+        stride_ = 1 + static_cast<std::size_t>(mix(~seed_) % (blocks_ - 1));
+        while (std::gcd(stride_, blocks_) != 1) stride_ = stride_ % (blocks_ - 1) + 1;
+        std::size_t total = (blocks_ * block_size + length_ + block_size - 1) / block_size * block_size;
+        data_.resize(total);
+        generate();
+        crc_.resize(total / block_size);
+        for (std::size_t b = 0; b < crc_.size(); ++b) crc_[b] = crc32c(data_.data() + b * block_size, block_size);
+    }
+
+    std::size_t length() const { return length_; }
+    std::uint64_t seed() const { return seed_; }
+
+    // 訊息起點一定對齊 block，所以訊息內的第 k 個 block 就是 pool 的某個 block
+    // 起點由連線決定，之後每則往後走 stride_ 個 block
+    std::size_t offset(std::uint32_t conn, std::uint32_t seq) const {
+        std::size_t first = static_cast<std::size_t>(mix(seed_ ^ (static_cast<std::uint64_t>(conn) << 32)) % blocks_);
+        return (first + (seq % blocks_) * stride_) % blocks_ * block_size;
+    }
+
+    const char* data(std::size_t offset) const { return data_.data() + offset; }
+    std::uint32_t block_crc(std::size_t offset) const { return crc_[offset / block_size]; }
+
+private:
+    static std::uint64_t mix(std::uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // 由 seed 挑字組成的文字，可壓縮，跟 --compress 一起測時比較接近實際訊息
+    void generate() {
+        static const char* const words[] = {
+            "order", "BUY", "SELL", "symbol=", "2330.TW", "qty=", "1000", "price=", "1025.0",
+            "account=", "000123", "status", "FILLED", "NEW", "time=", "09:00:00", "; ", " " };
+        const std::size_t nwords = sizeof(words) / sizeof(words[0]);
+        std::uint64_t state = seed_;
+        std::size_t pos = 0;
+        while (pos < data_.size()) {
+            state = mix(state);
+            const char* w = words[state % nwords];
+            std::size_t n = std::strlen(w);
+            if (n > data_.size() - pos) n = data_.size() - pos;
+            std::memcpy(data_.data() + pos, w, n);
+            pos += n;
+        }
+        // 每個 block 開頭 4 bytes 放 block 編號 (base32)，不同位置的訊息至少前 4 bytes 不同，
+        // 訊息很短時也分得出來 (2^20 個 block 以內)
+        static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+        for (std::size_t b = 0; b * block_size < data_.size(); ++b) {
+            char* tag = data_.data() + b * block_size;
+            for (int i = 0; i < 4; ++i) tag[i] = digits[(b >> (5 * i)) & 31];
+        }
+    }
+
+    std::uint64_t seed_;
+    std::size_t length_;
+    std::size_t blocks_;
+    std::size_t stride_;
+    std::vector<char> data_;
+    std::vector<std::uint32_t> crc_;
+};
+
+// 一則 echo 的接收端驗證，收到一段驗一段，不保留已收資料
+class PayloadVerifier {
+public:
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    void begin(const PayloadPool& pool, std::size_t offset) {
+        pool_ = &pool;
+        offset_ = offset;
+        pos_ = 0;
+        error_ = npos;
+    }
+
+    // data 是訊息中第 received() byte 開始的 n bytes。
+    // 發現錯誤後仍繼續累計收到的長度 (讓呼叫端把這則讀完)，只記第一個錯誤位置
+    void update(const char* data, std::size_t n) {
+        const std::size_t bs = PayloadPool::block_size;
+        if (n > remaining()) {
+            if (error_ == npos) error_ = pool_->length();
+            pos_ = pool_->length();
+            return;
+        }
+        if (error_ != npos) {
+            pos_ += n;
+            return;
+        }
+        while (n > 0) {
+            std::size_t piece = std::min(n, bs - pos_ % bs);
+            const char* expect = pool_->data(offset_ + pos_);
+            bool ok = piece == bs
+                ? crc32c(data, bs) == pool_->block_crc(offset_ + pos_)
+                : std::memcmp(data, expect, piece) == 0;
+            if (!ok) {
+                std::size_t i = 0;
+                while (i < piece && data[i] == expect[i]) ++i;
+                error_ = pos_ + i;
+                pos_ += n;
+                return;
+            }
+            pos_ += piece;
+            data += piece;
+            n -= piece;
+        }
+    }
+
+    std::size_t received() const { return pos_; }
+    std::size_t remaining() const { return pool_->length() - pos_; }
+    bool done() const { return pos_ == pool_->length(); }
+    bool ok() const { return error_ == npos; }
+    // 第一個錯誤 byte 在訊息中的位置；沒有錯但不完整時為收到的長度
+    std::size_t error_offset() const { return error_ != npos ? error_ : pos_; }
+
+private:
+    const PayloadPool* pool_ = nullptr;
+    std::size_t offset_ = 0;
+    std::size_t pos_ = 0;
+    std::size_t error_ = npos;
+};
+
+// 接收 buffer 大小：訊息小就用訊息大小，大訊息用固定 64KB (block 的整數倍) 分段收
+inline std::size_t payload_rx_size(std::size_t length) {
+    return std::max<std::size_t>(1, std::min(length, 16 * PayloadPool::block_size));
+}
+
+// --payload-bytes=N (預設 64，至少 4 bytes 才保證每則內容不同) --seed=S (預設 1) --payload-pool-kb=K (預設 1024)
+inline std::unique_ptr<const PayloadPool> payload_pool_from(const Options& opt) {
+    long long bytes = opt.get_int("payload-bytes", 64);
+    long long pool_kb = opt.get_int("payload-pool-kb", 1024);
+    return std::make_unique<const PayloadPool>(static_cast<std::uint64_t>(opt.get_int("seed", 1)),
+        static_cast<std::size_t>(bytes > 0 ? bytes : 64), static_cast<std::size_t>(pool_kb > 0 ? pool_kb : 1) * 1024);
+}
@@ -0,0 +1,239 @@
+﻿#pragma once
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "capture.h"
+
+// 依錄製檔重播流量 (--replay)：照錄製的時間點開連線、每筆訊息各自一次 write、關連線
+// 訊息內容一律取自共用的 payload，record 直接從 mmap 讀。
+// 開始前建一次索引 (每筆 record 指向同一條連線的下一筆)，之後每條連線在自己的 strand 上
+// 用 timer 走自己的 record，重播時不再配置記憶體，也不經過單一 thread 轉送。
+
+using ReplayStrand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+struct ReplayStats {
+    std::atomic<std::uint64_t> connections{ 0 };
+    std::atomic<std::uint64_t> messages{ 0 };
+    std::atomic<std::uint64_t> tx{ 0 };
+    std::atomic<std::uint64_t> rx{ 0 };
+    std::atomic<std::uint64_t> errors{ 0 };
+    std::atomic<std::uint64_t> unechoed{ 0 };   // 逾時關閉時還沒收到 echo 的 bytes
+};
+
+// 所有連線共用、建好後不再修改
+struct ReplayPlan {
+    static constexpr std::uint32_t npos = 0xffffffffu;
+
+    ReplayPlan(const CaptureFile& file, double speed_) : capture(file), speed(speed_) {
+        const std::size_t n = capture.size();
+        next.assign(n, npos);
+        std::vector<std::uint32_t> last;
+        for (std::uint32_t i = 0; i < n; ++i) {
+            const CaptureRecord& r = record(i);
+            if (r.conn >= last.size()) last.resize(r.conn + 1, npos);
+            if (r.kind() == CaptureRecord::open) opens.push_back(i);
+            else if (last[r.conn] != npos) next[last[r.conn]] = i;
+            last[r.conn] = i;
+        }
+        base_us = n > 0 ? record(0).time_us : 0;
+    }
+
+    const CaptureRecord& record(std::uint32_t i) const { return capture.begin()[i]; }
+
+    // speed: 1 = 原速，10 = 十倍速，<= 0 = 不等待盡快送
+    bool paced() const { return speed > 0; }
+    std::chrono::steady_clock::time_point at(std::uint64_t time_us) const {
+        return start + std::chrono::microseconds(static_cast<long long>((time_us - base_us) / speed));
+    }
+
+    const CaptureFile& capture;
+    double speed;
+    std::uint64_t base_us = 0;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::uint32_t> next;   // 同一條連線的下一筆 record，npos = 沒有了
+    std::vector<std::uint32_t> opens;  // OPEN record，依時間排序
+};
+
+// plain / TLS 不同的部分：建立 stream、連線 (+handshake)、關閉
+template <class Stream>
+struct ReplayTransport {
+    std::function<std::unique_ptr<Stream>(const ReplayStrand&)> make;
+    std::function<void(Stream&, const boost::asio::ip::tcp::resolver::results_type&,
+        std::function<void(boost::system::error_code)>)> connect;
+    std::function<void(Stream&, std::function<void()>)> close;
+};
+
+// 一條重播連線，所有狀態只在自己的 strand 上改動
+// cursor_ 指向下一筆要處理的 record；一次只送一筆，送完才排下一筆
+template <class Stream>
+class ReplayConnection : public std::enable_shared_from_this<ReplayConnection<Stream>> {
+public:
+    ReplayConnection(boost::asio::io_context& io, const ReplayTransport<Stream>& transport,
+        const std::vector<char>& payload, ReplayStats& stats, std::shared_ptr<const ReplayPlan> plan, std::uint32_t open)
+        : strand_(boost::asio::make_strand(io)), stream_(transport.make(strand_)), timer_(strand_), transport_(transport),
+        payload_(payload), stats_(stats), plan_(std::move(plan)), cursor_(plan_->next[open]) {}
+
+    void open(const boost::asio::ip::tcp::resolver::results_type& endpoints) {
+        auto self(this->shared_from_this());
+        boost::asio::post(strand_, [this, self, &endpoints]() {
+            transport_.connect(*stream_, endpoints, [this, self](boost::system::error_code ec) {
+                if (ec) {
+                    ++stats_.errors;
+                    closing_ = true;
+                    return;
+                }
+                ++stats_.connections;
+                connected_ = true;
+                do_read();
+                next_record();
+            });
+        });
+    }
+
+private:
+    // 下一筆是 DATA 就等到它的時間點送出；CLOSE 或錄製檔結束就在 echo 收齊後關閉，
+    // server 一直沒回完時 drain_timeout 後強制關閉，沒收到的算錯誤
+    void next_record() {
+        if (closing_) return;
+        if (cursor_ == ReplayPlan::npos || plan_->record(cursor_).kind() != CaptureRecord::data) {
+            close_requested_ = true;
+            maybe_close();
+            if (!closing_) wait_drain();
+            return;
+        }
+        const CaptureRecord& r = plan_->record(cursor_);
+        remaining_ = r.length();
+        if (plan_->paced()) {
+            auto at = plan_->at(r.time_us);
+            if (at > std::chrono::steady_clock::now()) {
+                auto self(this->shared_from_this());
+                timer_.expires_at(at);
+                timer_.async_wait([this, self](boost::system::error_code ec) {
+                    if (!ec) do_write();
+                });
+                return;
+            }
+        }
+        do_write();
+    }
+
+    // 比 payload 大的訊息分幾次 write，仍算一則
+    void do_write() {
+        if (closing_) return;
+        writing_ = true;
+        auto self(this->shared_from_this());
+        std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(remaining_, payload_.size()));
+        boost::asio::async_write(*stream_, boost::asio::buffer(payload_.data(), n),
+            [this, self](boost::system::error_code ec, std::size_t length) {
+                writing_ = false;
+                if (ec) {
+                    fail();
+                    return;
+                }
+                remaining_ -= length;
+                tx_ += length;
+                stats_.tx += length;
+                if (remaining_ > 0) {
+                    do_write();
+                    return;
+                }
+                ++stats_.messages;
+                cursor_ = plan_->next[cursor_];
+                next_record();
+            });
+    }
+
+    void do_read() {
+        auto self(this->shared_from_this());
+        stream_->async_read_some(boost::asio::buffer(reply_),
+            [this, self](boost::system::error_code ec, std::size_t length) {
+                if (ec) {
+                    if (!closing_) fail();
+                    return;
+                }
+                rx_ += length;
+                stats_.rx += length;
+                maybe_close();
+                if (!closing_) do_read();
+            });
+    }
+
+    void maybe_close() {
+        if (!close_requested_ || !connected_ || closing_ || writing_ || rx_ < tx_) return;
+        closing_ = true;
+        timer_.cancel();
+        auto self(this->shared_from_this());
+        transport_.close(*stream_, [self]() {});
+    }
+
+    void wait_drain() {
+        auto self(this->shared_from_this());
+        timer_.expires_after(drain_timeout);
+        timer_.async_wait([this, self](boost::system::error_code ec) {
+            if (ec || closing_) return;
+            ++stats_.errors;
+            stats_.unechoed += tx_ - rx_;
+            closing_ = true;
+            transport_.close(*stream_, [self]() {});
+        });
+    }
+
+    void fail() {
+        ++stats_.errors;
+        closing_ = true;
+        timer_.cancel();
+        transport_.close(*stream_, [self = this->shared_from_this()]() {});
+    }
+
+    static constexpr std::chrono::seconds drain_timeout{ 10 };
+
+    ReplayStrand strand_;
+    std::unique_ptr<Stream> stream_;
+    boost::asio::steady_timer timer_;
+    const ReplayTransport<Stream>& transport_;
+    const std::vector<char>& payload_;
+    ReplayStats& stats_;
+    std::shared_ptr<const ReplayPlan> plan_;
+    std::uint32_t cursor_;
+    char reply_[16 * 1024];
+    std::uint64_t remaining_ = 0, tx_ = 0, rx_ = 0;
+    bool connected_ = false, writing_ = false, closing_ = false, close_requested_ = false;
+};
+
+// 呼叫端 thread 只負責依時間開連線，訊息由各連線自己排程；io 由其他 thread 執行
+// 回傳時連線可能還在重播，呼叫端等 io thread 結束
+template <class Stream>
+void replay_capture(const CaptureFile& capture, boost::asio::io_context& io,
+    const boost::asio::ip::tcp::resolver::results_type& endpoints, const ReplayTransport<Stream>& transport,
+    const std::vector<char>& payload, double speed, ReplayStats& stats) {
+    using Connection = ReplayConnection<Stream>;
+    if (capture.size() == 0) return;
+    auto plan = std::make_shared<ReplayPlan>(capture, speed);
+    plan->start = std::chrono::steady_clock::now();
+    for (std::uint32_t i : plan->opens) {
+        if (plan->paced()) {
+            auto target = plan->at(plan->record(i).time_us);
+            if (target > std::chrono::steady_clock::now()) std::this_thread::sleep_until(target);
+        }
+        std::make_shared<Connection>(io, transport, payload, stats, plan, i)->open(endpoints);
+    }
+}
+
+// 例: "replayed 1200 connections, 53000 messages in 2.10 s (25238 msg/s), tx 12.5 MB rx 12.5 MB, 0 errors (0 bytes not echoed)"
+inline std::string replay_report(const ReplayStats& stats, double wall_sec) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf),
+        "replayed %llu connections, %llu messages in %.2f s (%.0f msg/s), tx %.1f MB rx %.1f MB, %llu errors (%llu bytes not echoed)",
+        (unsigned long long)stats.connections.load(), (unsigned long long)stats.messages.load(), wall_sec,
+        wall_sec > 0 ? stats.messages.load() / wall_sec : 0.0, stats.tx.load() / 1e6, stats.rx.load() / 1e6,
+        (unsigned long long)stats.errors.load(), (unsigned long long)stats.unechoed.load());
+    return buf;
+}
@@ -0,0 +1,152 @@
+﻿#pragma once
+#include <boost/asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "options.h"
+
+// client 壓測的階段控制：warm-up -> measure -> cool-down
+// --measure=N 秒時為計時模式，連線持續 write/read 直到 cool-down 結束，忽略固定次數；
+// 每進入下一個階段統計歸零，只輸出 measure 階段的結果。
+// 沒給 --measure 時整段都算 measure，結束後輸出一次。
+// 連不上 / handshake / hello 失敗的連線另外累計，不隨階段歸零 (多半發生在 warm-up)。
+
+struct RunStats {
+    std::atomic<std::uint64_t> messages{ 0 };
+    std::atomic<std::uint64_t> bytes{ 0 };
+    std::atomic<std::uint64_t> wire_bytes{ 0 };
+    std::atomic<std::uint64_t> errors{ 0 };
+    std::atomic<std::uint64_t> latency_us_sum{ 0 };
+    std::atomic<std::uint64_t> latency_us_max{ 0 };
+
+    void reset() {
+        messages = 0;
+        bytes = 0;
+        wire_bytes = 0;
+        errors = 0;
+        latency_us_sum = 0;
+        latency_us_max = 0;
+    }
+
+    // length = 訊息原始大小，wire = 實際在線上的大小 (壓縮後含 frame header)
+    void record(std::uint64_t latency_us, std::size_t length, std::size_t wire) {
+        ++messages;
+        bytes += length;
+        wire_bytes += wire;
+        latency_us_sum += latency_us;
+        std::uint64_t prev = latency_us_max.load(std::memory_order_relaxed);
+        while (prev < latency_us && !latency_us_max.compare_exchange_weak(prev, latency_us)) {}
+    }
+};
+
+class RunController {
+public:
+    enum Phase { idle, warmup, measure, cooldown, done };
+
+    void configure(const Options& opt) {
+        warmup_sec_ = static_cast<int>(opt.get_int("warmup", 0));
+        measure_sec_ = static_cast<int>(opt.get_int("measure", 0));
+        cooldown_sec_ = static_cast<int>(opt.get_int("cooldown", 0));
+    }
+
+    bool timed() const { return measure_sec_ > 0; }
+    Phase phase() const { return phase_.load(); }
+    bool finished() const { return phase_.load() == done; }
+
+    // 計時模式下由 io 上的 timer 切換階段，不佔用 thread
+    void start(boost::asio::io_context& io) {
+        timer_ = std::make_unique<boost::asio::steady_timer>(io);
+        enter(timed() ? warmup : measure);
+        if (!timed()) return;
+        std::cout << "[run] warm-up " << warmup_sec_ << " s" << std::endl;
+        schedule(warmup_sec_, [this]() {
+            enter(measure);
+            std::cout << "[run] measure " << measure_sec_ << " s" << std::endl;
+            schedule(measure_sec_, [this]() {
+                std::cout << "[run] " << report() << std::endl;
+                enter(cooldown);
+                std::cout << "[run] cool-down " << cooldown_sec_ << " s" << std::endl;
+                schedule(cooldown_sec_, [this]() {
+                    enter(done);
+                });
+            });
+        });
+    }
+
+    // 所有連線結束、io 執行緒都回來之後呼叫 (io_context 還在)；timer 在這裡釋放，
+    // 不留到 g_run 解構時才碰已經不在的 io_context
+    void finish() {
+        if (!timed()) std::cout << "[run] " << report() << std::endl;
+        enter(done);
+        timer_.reset();
+    }
+
+    void record(std::uint64_t latency_us, std::size_t length) { record(latency_us, length, length); }
+    void record(std::uint64_t latency_us, std::size_t length, std::size_t wire) {
+        stats_.record(latency_us, length, wire);
+        ++completed_;
+        touch();
+    }
+    void error() {
+        ++stats_.errors;
+        touch();
+    }
+    // connect、TLS handshake 或壓縮 hello 失敗，這條連線沒有送出任何訊息
+    void connection_failed() {
+        ++failed_connections_;
+        touch();
+    }
+
+    // 整次執行 (不分階段) 至少完成一則訊息，main 用來決定 exit code
+    bool succeeded() const { return completed_.load() > 0; }
+
+    // 例: "measure 30.0 s: 12000 msgs (400 msg/s), 1.2 MB (wire 0.3 MB), latency avg 0.52 ms max 3.10 ms, 0 errors, 0 failed connections"
+    // 沒給 --measure 時只算到最後一則訊息完成，不含之後關閉連線等待的時間
+    std::string report() const {
+        auto end = std::chrono::steady_clock::now();
+        auto last = last_activity_.load();
+        if (!timed() && last != 0) end = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(last));
+        double sec = std::chrono::duration<double>(end - phase_begin_).count();
+        std::uint64_t n = stats_.messages.load();
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+            "measure %.1f s: %llu msgs (%.0f msg/s), %.1f MB (wire %.1f MB), latency avg %.2f ms max %.2f ms, %llu errors, %llu failed connections",
+            sec, (unsigned long long)n, sec > 0 ? n / sec : 0.0, stats_.bytes.load() / 1e6, stats_.wire_bytes.load() / 1e6,
+            n > 0 ? stats_.latency_us_sum.load() / 1000.0 / n : 0.0, stats_.latency_us_max.load() / 1000.0,
+            (unsigned long long)stats_.errors.load(), (unsigned long long)failed_connections_.load());
+        return buf;
+    }
+
+private:
+    void enter(Phase p) {
+        stats_.reset();
+        last_activity_ = 0;
+        phase_begin_ = std::chrono::steady_clock::now();
+        phase_ = p;
+    }
+
+    void touch() {
+        if (!timed()) last_activity_ = std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    template <class Handler>
+    void schedule(int seconds, Handler next) {
+        timer_->expires_after(std::chrono::seconds(seconds));
+        timer_->async_wait([next](boost::system::error_code ec) {
+            if (!ec) next();
+        });
+    }
+
+    int warmup_sec_ = 0, measure_sec_ = 0, cooldown_sec_ = 0;
+    std::atomic<Phase> phase_{ idle };
+    std::chrono::steady_clock::time_point phase_begin_;
+    RunStats stats_;
+    std::atomic<std::chrono::steady_clock::rep> last_activity_{ 0 };
+    std::atomic<std::uint64_t> failed_connections_{ 0 };
+    std::atomic<std::uint64_t> completed_{ 0 };
+    std::unique_ptr<boost::asio::steady_timer> timer_;
+};
@@ -3,11 +3,18 @@
 #include <memory>
 #include <chrono>
 #include <fstream>
+#include <cstring>
 #include "writelog.h"
+#include "options.h"
+#include "stream_io.h"
+#include "capture.h"
+#include "compress.h"
 
 using boost::asio::ip::tcp;
 
 Logger g_logger("checkserver");
+std::unique_ptr<CaptureWriter> g_capture; // --capture ɿUCsuTjpPɶ
+CompressConfig g_compress;                // client  hello Ӯɤ\Y覡
 
 std::string getCurrentSystemTime() {
     auto tt = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -20,11 +27,78 @@ std::string getCurrentSystemTime() {
 
 class Session : public std::enable_shared_from_this<Session> {
 public:
-    Session(tcp::socket socket) : socket_(std::move(socket)) {}
+    Session(tcp::socket socket) : socket_(std::move(socket)), frames_(socket_) {}
+    ~Session() {
+        if (g_capture) {
+            if (capture_pending_ > 0) g_capture->data(capture_id_, capture_pending_);
+            g_capture->close_connection(capture_id_);
+        }
+    }
 
-    void start() { do_read(); }
+    void start() {
+        if (g_capture) capture_id_ = g_capture->open_connection();
+        read_hello();
+    }
 
 private:
+    // Ĥ@쪺ƬO hello N飼 frame (iY)AOܾqT echo
+    // have = wBiOQ} hello  bytes
+    void read_hello(std::size_t have = 0) {
+        auto self(shared_from_this());
+        socket_.async_read_some(boost::asio::buffer(data_ + have, max_length - have),
+            [this, self, have](boost::system::error_code ec, std::size_t length) {
+                length += have;
+                if (ec == boost::asio::error::eof) {
+                    do_exit();
+                }
+                else if (ec) {
+                    g_logger.log("Server get error from reading " + ec.message());
+                }
+                else if (length < hello_size && is_hello_prefix(data_, length)) {
+                    read_hello(length);
+                }
+                else if (length == hello_size && is_hello(data_)) {
+                    frames_.async_server_hello(data_, g_compress, [this, self](boost::system::error_code ec) {
+                        if (!ec) do_frame_read();
+                        else g_logger.log("Server get error from writing hello " + ec.message());
+                    });
+                }
+                else {
+                    capture_read(length);
+                    do_write(length);
+                }
+            });
+    }
+
+    // Ѷ} client  frame AΨӦn覡Y^e
+    void do_frame_read() {
+        auto self(shared_from_this());
+        frames_.async_receive(
+            [this, self](boost::system::error_code ec, const char* data, std::size_t length, std::size_t /*wire*/, bool more) {
+                if (ec == boost::asio::error::eof) {
+                    do_exit();
+                    return;
+                }
+                else if (ec) {
+                    g_logger.log("Server get error from reading frame " + ec.message());
+                    do_exit();
+                    return;
+                }
+                // @hTih frameAv frame ^eAh~O
+                if (g_capture) {
+                    capture_pending_ += length;
+                    if (!more) {
+                        g_capture->data(capture_id_, capture_pending_);
+                        capture_pending_ = 0;
+                    }
+                }
+                frames_.async_send_frame(data, length, more, [this, self](boost::system::error_code ec, std::size_t) {
+                    if (!ec) do_frame_read();
+                    else g_logger.log("Server get error from writing frame " + ec.message());
+                });
+            });
+    }
+
     void do_read() {
         auto self(shared_from_this());
         socket_.async_read_some(
@@ -35,6 +109,7 @@ private:
                     do_exit();
                 }
                 else if(!ec) {
+                    capture_read(length);
                     std::string reply(data_, length);
                     std::string date = getCurrentSystemTime();
                     g_logger.log("Server get " + reply +" Server time(MM/SS) " + date);
@@ -47,6 +122,17 @@ private:
         
     }
 
+    // raw echo STɡA@ read uO data_ jpF
+    // s򦬨쪺 ( socket wSѾl) X֦@hOAframe ҦhOChT@h
+    void capture_read(std::size_t length) {
+        if (!g_capture) return;
+        capture_pending_ += length;
+        boost::system::error_code ec;
+        if ((socket_.available(ec) > 0 && !ec)) return;
+        g_capture->data(capture_id_, capture_pending_);
+        capture_pending_ = 0;
+    }
+
     void do_write(std::size_t length) {
         auto self(shared_from_this());
         boost::asio::async_write(
@@ -76,17 +162,219 @@ private:
     tcp::socket socket_;
     enum { max_length = 1024 };
     char data_[max_length];
+    std::uint32_t capture_id_ = 0;
+    std::size_t capture_pending_ = 0;
+    FrameChannel<tcp::socket> frames_;
+};
+
+// yҦGhӤj buffer զ ringAŪgPɶi (full-duplex echo)
+// fill_ / sent_ / freed_ O֭p slot ơAڦm = p % slots_.size()
+// Ūi slot(fill_)BeX slot(sent_)Fzerocopy ɭn kernel q~ freed_
+class StreamSession : public std::enable_shared_from_this<StreamSession> {
+public:
+    StreamSession(tcp::socket socket, const StreamConfig& cfg, StreamStats& stats)
+        : socket_(std::move(socket)), slots_(cfg.buffer_count), stats_(stats), want_zerocopy_(cfg.zerocopy) {
+        for (auto& s : slots_) s.data.resize(cfg.buffer_size);
+    }
+    ~StreamSession() {
+        if (g_capture) g_capture->close_connection(capture_id_);
+    }
+
+    // ySTɡA--capture ɨC read O@ (OdOɶbW bytes)
+    void start() {
+        if (g_capture) capture_id_ = g_capture->open_connection();
+        if (want_zerocopy_ && !zc_.enable(socket_.native_handle())) {
+            g_logger.log("MSG_ZEROCOPY not supported, stream uses copy send");
+        }
+        pump();
+    }
+
+private:
+    struct Slot {
+        std::vector<char> data;
+        std::size_t length = 0;
+        std::uint32_t zc_issued = 0;
+    };
+
+    Slot& slot(std::size_t n) { return slots_[n % slots_.size()]; }
+
+    void pump() {
+        if (closed_) return;
+        do_write();
+        do_read();
+        finish_if_done();
+    }
+
+    void do_read() {
+        reclaim();
+        if (reading_ || eof_ || closed_) return;
+        if (fill_ - freed_ == slots_.size()) {
+            if (sent_ > freed_) wait_completions(); // ring FBdb zerocopy q
+            return;
+        }
+        reading_ = true;
+        auto self(shared_from_this());
+        Slot& s = slot(fill_);
+        socket_.async_read_some(
+            boost::asio::buffer(s.data),
+            [this, self](boost::system::error_code ec, std::size_t length) {
+                reading_ = false;
+                if (ec == boost::asio::error::eof) {
+                    eof_ = true;
+                }
+                else if (!ec) {
+                    slot(fill_).length = length;
+                    ++fill_;
+                    stats_.rx += length;
+                    if (g_capture) g_capture->data(capture_id_, length);
+                }
+                else if (ec != boost::asio::error::operation_aborted) {
+                    g_logger.log("Server get error from stream reading " + ec.message());
+                    do_exit();
+                }
+                pump();
+            });
+    }
+
+    void do_write() {
+        if (writing_ || sent_ == fill_ || closed_) return;
+        writing_ = true;
+        if (zc_.enabled()) {
+            write_zerocopy();
+            return;
+        }
+        auto self(shared_from_this());
+        Slot& s = slot(sent_);
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(s.data.data(), s.length),
+            [this, self](boost::system::error_code ec, std::size_t length) {
+                writing_ = false;
+                if (!ec) {
+                    stats_.tx += length;
+                    ++sent_;
+                }
+                else if (ec != boost::asio::error::operation_aborted) {
+                    g_logger.log("Server get error from stream writing " + ec.message());
+                    do_exit();
+                }
+                pump();
+            });
+    }
+
+    void write_zerocopy() {
+        Slot& s = slot(sent_);
+        int fd = socket_.native_handle();
+        while (offset_ < s.length) {
+            long n = zc_.send(fd, s.data.data() + offset_, s.length - offset_);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    auto self(shared_from_this());
+                    socket_.async_wait(tcp::socket::wait_write,
+                        [this, self](boost::system::error_code ec) {
+                            if (ec) {
+                                writing_ = false;
+                                return;
+                            }
+                            write_zerocopy();
+                        });
+                    return;
+                }
+                g_logger.log(std::string("Server get error from zerocopy send ") + std::strerror(errno));
+                writing_ = false;
+                do_exit();
+                return;
+            }
+            offset_ += static_cast<std::size_t>(n);
+            stats_.tx += static_cast<std::uint64_t>(n);
+        }
+        s.zc_issued = zc_.issued();
+        offset_ = 0;
+        ++sent_;
+        writing_ = false;
+        pump();
+    }
+
+    // ^we (zerocopy hO kernel wΧ)  slot
+    void reclaim() {
+        if (!zc_.enabled()) {
+            freed_ = sent_;
+            return;
+        }
+        zc_.poll_completions(socket_.native_handle());
+        while (freed_ < sent_ && zc_.completed(slot(freed_).zc_issued)) ++freed_;
+    }
+
+    // qb error queueAsocket |ܦ error A
+    // epoll O edge-triggeredGW@ reclaim() Basync_wait e쪺q|As waitA
+    // ҥH wait WAˬd@ error queue
+    void wait_completions() {
+        if (waiting_zc_ || closed_) return;
+        waiting_zc_ = true;
+        auto self(shared_from_this());
+        socket_.async_wait(tcp::socket::wait_error,
+            [this, self](boost::system::error_code ec) {
+                waiting_zc_ = false;
+                if (!ec) pump();
+            });
+        boost::asio::post(socket_.get_executor(), [this, self]() {
+            std::size_t before = freed_;
+            reclaim();
+            if (freed_ != before || zc_.idle()) pump();
+        });
+    }
+
+    // client e (EOF) BƳ^e~
+    void finish_if_done() {
+        if (!eof_ || writing_ || sent_ != fill_ || closed_) return;
+        reclaim();
+        if (zc_.enabled() && !zc_.idle()) {
+            wait_completions();
+            return;
+        }
+        do_exit();
+    }
+
+    void do_exit() {
+        closed_ = true;
+        boost::system::error_code ignored_ec;
+        socket_.shutdown(tcp::socket::shutdown_both, ignored_ec);
+        socket_.close(ignored_ec);
+    }
+
+    tcp::socket socket_;
+    std::vector<Slot> slots_;
+    std::size_t fill_ = 0, sent_ = 0, freed_ = 0;
+    std::size_t offset_ = 0;
+    bool reading_ = false, writing_ = false, waiting_zc_ = false;
+    bool eof_ = false, closed_ = false;
+    StreamStats& stats_;
+    bool want_zerocopy_;
+    ZeroCopy zc_;
+    std::uint32_t capture_id_ = 0;
 };
 
 class Server {
 public:
-    Server(boost::asio::io_context& io_context, short port)
-        : acceptor_(io_context, tcp::endpoint(tcp::v4(), port)) {
+    Server(boost::asio::io_context& io_context, short port, const StreamConfig& stream)
+        : io_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), port)),
+        stream_(stream), report_timer_(io_context) {
         do_accept();
+        if (stream_.enabled) do_report();
     }
 
 private:
     void do_accept() {
+        if (stream_.enabled) {
+            // y session ŪgPɶiAn strand O@
+            acceptor_.async_accept(boost::asio::make_strand(io_),
+                [this](boost::system::error_code ec, tcp::socket socket) {
+                    if (!ec) {
+                        std::make_shared<StreamSession>(std::move(socket), stream_, stats_)->start();
+                    }
+                    do_accept();
+                });
+            return;
+        }
         acceptor_.async_accept(
             [this](boost::system::error_code ec, tcp::socket socket) {
                 if (!ec) {
@@ -96,18 +384,57 @@ private:
             });
     }
 
+    // C report_sec X@y]RqPC GB O CPU 
+    void do_report() {
+        last_wall_ = std::chrono::steady_clock::now();
+        last_cpu_ = process_cpu_seconds();
+        report_timer_.expires_after(std::chrono::seconds(stream_.report_sec));
+        report_timer_.async_wait([this](boost::system::error_code ec) {
+            if (ec) return;
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - last_wall_).count();
+            double cpu = process_cpu_seconds() - last_cpu_;
+            std::uint64_t rx = stats_.rx.exchange(0), tx = stats_.tx.exchange(0);
+            if (rx + tx > 0) {
+                std::cout << "[stream] " << format_throughput(rx, tx, wall, cpu) << std::endl;
+            }
+            do_report();
+        });
+    }
+
+    boost::asio::io_context& io_;
     tcp::acceptor acceptor_;
+    StreamConfig stream_;
+    StreamStats stats_;
+    boost::asio::steady_timer report_timer_;
+    std::chrono::steady_clock::time_point last_wall_;
+    double last_cpu_ = 0;
 };
 
 int main(int argc, char* argv[]) {
     try {
-        if (argc != 2) {
-            std::cerr << "Usage: server <port>\n";
+        if (argc < 2) {
+            std::cerr << "Usage: server <port> [--mode=stream [--buffer-kb=256] [--buffers=4] [--zerocopy] [--report-sec=5]]"
+                " [--capture=<file>] [--compress=lz4|none] [--compress-min=256]\n";
             return 1;
         }
+        Options opt(argc, argv, 2);
+        StreamConfig stream = stream_config_from(opt);
+        g_compress = compress_config_from(opt, true);
         boost::asio::io_context io;
-        Server s(io, std::atoi(argv[1]));
-        std::cout << "Server running on port "<< argv[1] <<"...\n";
+
+        // s Ctrl-C n buffer gA
+        boost::asio::signal_set signals(io);
+        if (opt.has("capture")) {
+            g_capture = std::make_unique<CaptureWriter>(opt.get("capture"));
+            signals.add(SIGINT);
+            signals.add(SIGTERM);
+            signals.async_wait([&io](boost::system::error_code, int) {
+                g_capture->close();
+                io.stop();
+            });
+        }
+        Server s(io, std::atoi(argv[1]), stream);
+        std::cout << "Server running on port "<< argv[1] << (stream.enabled ? " (stream mode)" : "") <<"...\n";
         
         // ϥΦhɮį
         std::vector<std::thread> threads;
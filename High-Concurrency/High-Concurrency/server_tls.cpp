@@ -4,6 +4,9 @@
 #include <memory>
 #include <thread>
 #include "writelog.h"
+#include "tls_config.h"
+#include "capture.h"
+#include "compress.h"
 #include <atomic>
 
 std::atomic<int> clients_connections = 0;
@@ -12,18 +15,27 @@ using boost::asio::ip::tcp;
 namespace ssl = boost::asio::ssl;
 
 Logger g_logger("checkserver");
+std::unique_ptr<CaptureWriter> g_capture; // --capture ɿUCsuTjpPɶ
+CompressConfig g_compress;                // client  hello Ӯɤ\Y覡
 
 class Session : public std::enable_shared_from_this<Session> {
 public:
     Session(tcp::socket socket, ssl::context& ctx)
-        : ssl_socket_(std::move(socket), ctx) {}
+        : ssl_socket_(std::move(socket), ctx), frames_(ssl_socket_) {}
+    ~Session() {
+        if (g_capture) {
+            if (capture_pending_ > 0) g_capture->data(capture_id_, capture_pending_);
+            g_capture->close_connection(capture_id_);
+        }
+    }
 
     void start() {
+        if (g_capture) capture_id_ = g_capture->open_connection();
         auto self = shared_from_this();
         ssl_socket_.async_handshake(ssl::stream_base::server,
             [this, self](boost::system::error_code ec) {
                 if (!ec) {
-                    do_read();
+                    read_hello();
                 }
                 else {
                     g_logger.log("Handshake failed: " + ec.message());
@@ -32,6 +44,68 @@ public:
     }
 
 private:
+    // Ĥ@쪺ƬO hello N飼 frame (iY)AOܾqT echo
+    // have = wBiOQ} hello  bytes
+    void read_hello(std::size_t have = 0) {
+        auto self = shared_from_this();
+        ssl_socket_.async_read_some(boost::asio::buffer(data_ + have, max_length - have),
+            [this, self, have](boost::system::error_code ec, std::size_t length) {
+                length += have;
+                if (ec) {
+                    if (ec != boost::asio::error::eof) g_logger.log("Read error: " + ec.message());
+                    close();
+                }
+                else if (length < hello_size && is_hello_prefix(data_, length)) {
+                    read_hello(length);
+                }
+                else if (length == hello_size && is_hello(data_)) {
+                    frames_.async_server_hello(data_, g_compress, [this, self](boost::system::error_code ec) {
+                        if (!ec) {
+                            do_frame_read();
+                        }
+                        else {
+                            g_logger.log("Write error: " + ec.message());
+                            close();
+                        }
+                    });
+                }
+                else {
+                    capture_read(length);
+                    do_write(length);
+                }
+            });
+    }
+
+    // Ѷ} client  frame AΨӦn覡Y^e
+    void do_frame_read() {
+        auto self = shared_from_this();
+        frames_.async_receive(
+            [this, self](boost::system::error_code ec, const char* data, std::size_t length, std::size_t /*wire*/, bool more) {
+                if (ec) {
+                    if (ec != boost::asio::error::eof) g_logger.log("Read error: " + ec.message());
+                    close();
+                    return;
+                }
+                // @hTih frameAv frame ^eAh~O
+                if (g_capture) {
+                    capture_pending_ += length;
+                    if (!more) {
+                        g_capture->data(capture_id_, capture_pending_);
+                        capture_pending_ = 0;
+                    }
+                }
+                frames_.async_send_frame(data, length, more, [this, self](boost::system::error_code ec, std::size_t) {
+                    if (!ec) {
+                        do_frame_read();
+                    }
+                    else {
+                        g_logger.log("Write error: " + ec.message());
+                        close();
+                    }
+                });
+            });
+    }
+
     void do_read() {
         auto self = shared_from_this();
         ssl_socket_.async_read_some(
@@ -39,6 +113,7 @@ private:
             [this, self](boost::system::error_code ec, std::size_t length) {
                 try {
                     if (!ec) {
+                        capture_read(length);
                         std::string msg(data_, length);
                         g_logger.log("Server received: " + msg);
                         do_write(length);
@@ -63,6 +138,17 @@ private:
             });
     }
 
+    // raw echo STɡA@ read uO data_ jpF
+    // s򦬨쪺 ( socket wSѾl) X֦@hOAframe ҦhOChT@h
+    void capture_read(std::size_t length) {
+        if (!g_capture) return;
+        capture_pending_ += length;
+        boost::system::error_code ec;
+        if (SSL_pending(ssl_socket_.native_handle()) > 0 || (ssl_socket_.lowest_layer().available(ec) > 0 && !ec)) return;
+        g_capture->data(capture_id_, capture_pending_);
+        capture_pending_ = 0;
+    }
+
     void do_write(std::size_t length) {
         auto self = shared_from_this();
         boost::asio::async_write(
@@ -99,6 +185,9 @@ private:
     ssl::stream<tcp::socket> ssl_socket_;
     enum { max_length = 1024 };
     char data_[max_length];
+    std::uint32_t capture_id_ = 0;
+    std::size_t capture_pending_ = 0;
+    FrameChannel<ssl::stream<tcp::socket>> frames_;
 };
 
 class Server {
@@ -128,19 +217,35 @@ private:
 
 int main(int argc, char* argv[]) {
     try {
-        if (argc != 2) {
-            std::cerr << "Usage: server <port>\n";
+        if (argc < 2) {
+            std::cerr << "Usage: server <port> [--ciphersuites=..] [--groups=..] [--cert=ecdsa|rsa|both] [--provider=..] [--engine=..]"
+                " [--capture=<file>] [--compress=lz4|none] [--compress-min=256]\n";
             return 1;
         }
+        Options opt(argc, argv, 2);
+        TlsConfig tls = tls_config_from(opt);
+        load_crypto_backend(tls);
+        g_compress = compress_config_from(opt, true);
 
         boost::asio::io_context io;
 
+        // s Ctrl-C n buffer gA
+        boost::asio::signal_set signals(io);
+        if (opt.has("capture")) {
+            g_capture = std::make_unique<CaptureWriter>(opt.get("capture"));
+            signals.add(SIGINT);
+            signals.add(SIGTERM);
+            signals.async_wait([&io](boost::system::error_code, int) {
+                g_capture->close();
+                io.stop();
+            });
+        }
+
         // TLS 1.3 Server Context
         ssl::context ctx(ssl::context::tlsv13_server);
 
-        // J & p_ (Цۦͦ server.pem)
-        ctx.use_certificate_chain_file("server.pem");
-        ctx.use_private_key_file("server.pem", ssl::context::pem);
+        // J & p_ (Цۦͦ server.pem / server_ecdsa.pem / server_rsa.pem)
+        apply_server_tls_config(ctx, tls);
         // pG dhparam.pem iHҥΡ]i^
         // ctx.use_tmp_dh_file("dhparam.pem");
 
@@ -0,0 +1,167 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include "options.h"
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <cerrno>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#endif
+
+// 串流模式 (--mode=stream) 共用：流量統計、CPU 時間、Linux MSG_ZEROCOPY
+
+// 整個 process 的 user+kernel CPU 秒數
+inline double process_cpu_seconds() {
+#ifdef _WIN32
+    FILETIME create, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user);
+    auto to_sec = [](const FILETIME& ft) {
+        ULARGE_INTEGER v;
+        v.LowPart = ft.dwLowDateTime;
+        v.HighPart = ft.dwHighDateTime;
+        return v.QuadPart / 1e7;
+    };
+    return to_sec(kernel) + to_sec(user);
+#else
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+struct StreamConfig {
+    bool enabled = false;            // --mode=stream
+    std::size_t buffer_size = 256 * 1024;  // --buffer-kb
+    std::size_t buffer_count = 4;    // --buffers，server 端 ring 的 buffer 數
+    bool zerocopy = false;           // --zerocopy
+    int seconds = 10;                // --seconds，client 端串流時間
+    int report_sec = 5;              // --report-sec，server 端統計輸出間隔
+};
+
+inline StreamConfig stream_config_from(const Options& opt) {
+    StreamConfig cfg;
+    cfg.enabled = opt.get("mode") == "stream";
+    // 0 或負數不能直接轉 size_t (會變成極大值)，跟 0 一樣取最小值
+    long long buffer_kb = opt.get_int("buffer-kb", 256);
+    long long buffers = opt.get_int("buffers", 4);
+    cfg.buffer_size = buffer_kb > 0 ? static_cast<std::size_t>(buffer_kb) * 1024 : 1024;
+    cfg.buffer_count = buffers >= 2 ? static_cast<std::size_t>(buffers) : 2;
+    cfg.zerocopy = opt.has("zerocopy");
+    cfg.seconds = static_cast<int>(opt.get_int("seconds", 10));
+    cfg.report_sec = static_cast<int>(opt.get_int("report-sec", 5));
+    return cfg;
+}
+
+struct StreamStats {
+    std::atomic<std::uint64_t> rx{ 0 };
+    std::atomic<std::uint64_t> tx{ 0 };
+};
+
+// 例: "rx 9.41 Gbit/s tx 9.41 Gbit/s, 0.52 CPU-s/GB"
+inline std::string format_throughput(std::uint64_t rx, std::uint64_t tx, double wall_sec, double cpu_sec) {
+    double gb = (rx + tx) / 1e9;
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "rx %.2f Gbit/s tx %.2f Gbit/s, %.3f CPU-s/GB",
+        rx * 8 / 1e9 / wall_sec, tx * 8 / 1e9 / wall_sec, gb > 0 ? cpu_sec / gb : 0.0);
+    return buf;
+}
+
+// MSG_ZEROCOPY 傳送與完成通知追蹤，一個 socket 一份，只在該 socket 的 strand 上使用。
+// 每次成功的 zerocopy send 由 kernel 配一個遞增 id，完成後從 error queue 回報 [lo, hi]，
+// 在 id 完成之前 buffer 內容不可以改。
+class ZeroCopy {
+public:
+    // 不支援時回傳 false，呼叫端改用一般 async_write
+    bool enable(int fd) {
+#ifdef __linux__
+        int one = 1;
+        enabled_ = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#else
+        (void)fd;
+        enabled_ = false;
+#endif
+        return enabled_;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    // non-blocking send，回傳送出的 bytes，-1 時看 errno (EAGAIN = 等 writable)
+    long send(int fd, const char* data, std::size_t len) {
+#ifdef __linux__
+        long n = ::send(fd, data, len, MSG_ZEROCOPY | MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n >= 0) {
+            ++next_id_;
+            return n;
+        }
+        if (errno != ENOBUFS) return n;
+        // optmem 用完：這一次退回一般 copy send
+        return ::send(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+        (void)fd; (void)data; (void)len;
+        return -1;
+#endif
+    }
+
+    // buffer 送完時記下 issued()，completed(該值) 為 true 後才可重用
+    std::uint32_t issued() const { return next_id_; }
+    bool completed(std::uint32_t issued_count) const {
+        return static_cast<std::int32_t>(done_ - issued_count) >= 0;
+    }
+    bool idle() const { return done_ == next_id_; }
+
+    // 把 error queue 裡的完成通知讀完 (non-blocking)
+    void poll_completions(int fd) {
+#ifdef __linux__
+        for (;;) {
+            char control[128];
+            msghdr msg = {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+            for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+                auto* ee = reinterpret_cast<sock_extended_err*>(CMSG_DATA(cm));
+                if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+                complete_range(ee->ee_info, ee->ee_data);
+            }
+        }
+#else
+        (void)fd;
+#endif
+    }
+
+private:
+    // 通知通常依序到達，直接往前推；亂序的才放進 map 暫存
+    void complete_range(std::uint32_t lo, std::uint32_t hi) {
+        if (lo != done_) {
+            early_[lo] = hi;
+            return;
+        }
+        done_ = hi + 1;
+        if (early_.empty()) return;
+        for (auto it = early_.find(done_); it != early_.end(); it = early_.find(done_)) {
+            done_ = it->second + 1;
+            early_.erase(it);
+        }
+    }
+
+    bool enabled_ = false;
+    std::uint32_t next_id_ = 0;
+    std::uint32_t done_ = 0;
+    std::map<std::uint32_t, std::uint32_t> early_;
+};
@@ -0,0 +1,219 @@
+﻿#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/ec.h>
+#include <openssl/rsa.h>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "tls_config.h"
+
+// TLS 加密成本量測：在同一條 thread 用 BIO pair 跑 client/server，
+// 不經過網路，量每顆核心的 handshake/s 與加解密 MB/s
+
+using Clock = std::chrono::steady_clock;
+
+static std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, sep)) if (!item.empty()) out.push_back(item);
+    return out;
+}
+
+// OpenSSL 物件交給 unique_ptr 管，例外時也會釋放
+template <class T, void (*Free)(T*)>
+struct OsslFree {
+    void operator()(T* p) const { Free(p); }
+};
+using PkeyCtxPtr = std::unique_ptr<EVP_PKEY_CTX, OsslFree<EVP_PKEY_CTX, EVP_PKEY_CTX_free>>;
+using PkeyPtr = std::unique_ptr<EVP_PKEY, OsslFree<EVP_PKEY, EVP_PKEY_free>>;
+using X509Ptr = std::unique_ptr<X509, OsslFree<X509, X509_free>>;
+using SslCtxPtr = std::unique_ptr<SSL_CTX, OsslFree<SSL_CTX, SSL_CTX_free>>;
+
+// ecdsa = P-256，rsa = 2048 bits
+static PkeyPtr make_key(const std::string& type) {
+    EVP_PKEY* pkey = nullptr;
+    PkeyCtxPtr kctx(EVP_PKEY_CTX_new_id(type == "rsa" ? EVP_PKEY_RSA : EVP_PKEY_EC, nullptr));
+    if (!kctx || EVP_PKEY_keygen_init(kctx.get()) <= 0)
+        throw std::runtime_error(openssl_error("keygen init"));
+    if (type == "rsa") EVP_PKEY_CTX_set_rsa_keygen_bits(kctx.get(), 2048);
+    else EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx.get(), NID_X9_62_prime256v1);
+    if (EVP_PKEY_keygen(kctx.get(), &pkey) <= 0)
+        throw std::runtime_error(openssl_error("keygen " + type));
+    return PkeyPtr(pkey);
+}
+
+// 產生自簽憑證，不需要準備 pem 檔
+static X509Ptr make_cert(EVP_PKEY* pkey) {
+    X509Ptr cert(X509_new());
+    X509* x = cert.get();
+    if (x == nullptr) throw std::runtime_error(openssl_error("new cert"));
+    X509_set_version(x, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x), 3600);
+    X509_set_pubkey(x, pkey);
+    X509_NAME* name = X509_get_subject_name(x);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"tls_bench", -1, -1, 0);
+    X509_set_issuer_name(x, name);
+    if (!X509_sign(x, pkey, EVP_sha256()))
+        throw std::runtime_error(openssl_error("sign cert"));
+    return cert;
+}
+
+struct Combo {
+    std::string suite;
+    std::string group;
+    std::string cert;
+};
+
+class Bench {
+public:
+    Bench(const Combo& c, EVP_PKEY* key, X509* cert)
+        : server_ctx_(SSL_CTX_new(TLS_server_method())), client_ctx_(SSL_CTX_new(TLS_client_method())),
+        server_(server_ctx_.get()), client_(client_ctx_.get()) {
+        if (server_ == nullptr || client_ == nullptr) throw std::runtime_error(openssl_error("SSL_CTX_new"));
+        for (SSL_CTX* ctx : { server_, client_ }) {
+            SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+            TlsConfig cfg;
+            cfg.ciphersuites = c.suite;
+            cfg.groups = c.group;
+            apply_cipher_config(ctx, cfg);
+        }
+        SSL_CTX_set_num_tickets(server_, 0); // 每次都量完整 handshake
+        if (SSL_CTX_use_certificate(server_, cert) != 1 || SSL_CTX_use_PrivateKey(server_, key) != 1)
+            throw std::runtime_error(openssl_error("server cert " + c.cert));
+        std::string sigalgs = sigalgs_for_cert(c.cert);
+        if (!SSL_CTX_set1_sigalgs_list(client_, sigalgs.c_str()))
+            throw std::runtime_error(openssl_error("sigalgs " + sigalgs));
+    }
+    // 回傳 {handshake/s 兩端合計, handshake/s 只算 server 端}
+    std::pair<double, double> handshakes(double seconds) {
+        long n = 0;
+        Clock::duration server_time{};
+        auto begin = Clock::now();
+        while (Clock::now() - begin < std::chrono::duration<double>(seconds)) {
+            Pair p(client_, server_);
+            server_time += p.handshake();
+            ++n;
+        }
+        double total = std::chrono::duration<double>(Clock::now() - begin).count();
+        double server = std::chrono::duration<double>(server_time).count();
+        return { n / total, n / server };
+    }
+
+    // 單向 client -> server 16KB record，加密+解密合計 MB/s
+    double bulk(double mb) {
+        Pair p(client_, server_);
+        p.handshake();
+        std::vector<char> out(16384, 'x'), in(16384);
+        long long total = static_cast<long long>(mb * 1024 * 1024), done = 0;
+        auto begin = Clock::now();
+        while (done < total) {
+            if (SSL_write(p.c, out.data(), (int)out.size()) <= 0)
+                throw std::runtime_error(openssl_error("SSL_write"));
+            int r;
+            while ((r = SSL_read(p.s, in.data(), (int)in.size())) > 0) done += r;
+        }
+        double sec = std::chrono::duration<double>(Clock::now() - begin).count();
+        return done / sec / (1024.0 * 1024.0);
+    }
+
+private:
+    struct Pair {
+        SSL* c;
+        SSL* s;
+        Pair(SSL_CTX* cctx, SSL_CTX* sctx) : c(SSL_new(cctx)), s(SSL_new(sctx)) {
+            BIO *cb = nullptr, *sb = nullptr;
+            if (c == nullptr || s == nullptr || !BIO_new_bio_pair(&cb, 64 * 1024, &sb, 64 * 1024)) {
+                // 建構失敗不會呼叫解構，這裡自己釋放
+                std::string err = openssl_error("SSL_new");
+                SSL_free(c);
+                SSL_free(s);
+                throw std::runtime_error(err);
+            }
+            SSL_set_bio(c, cb, cb);
+            SSL_set_bio(s, sb, sb);
+            SSL_set_connect_state(c);
+            SSL_set_accept_state(s);
+        }
+        ~Pair() {
+            SSL_free(c);
+            SSL_free(s);
+        }
+        Clock::duration handshake() {
+            Clock::duration server_time{};
+            bool c_done = false, s_done = false;
+            while (!c_done || !s_done) {
+                if (!c_done) c_done = step(c);
+                auto t = Clock::now();
+                if (!s_done) s_done = step(s);
+                server_time += Clock::now() - t;
+            }
+            return server_time;
+        }
+        static bool step(SSL* ssl) {
+            int r = SSL_do_handshake(ssl);
+            if (r == 1) return true;
+            int err = SSL_get_error(ssl, r);
+            if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+                throw std::runtime_error(openssl_error("handshake"));
+            return false;
+        }
+    };
+
+    SslCtxPtr server_ctx_;
+    SslCtxPtr client_ctx_;
+    SSL_CTX* server_;
+    SSL_CTX* client_;
+};
+
+int main(int argc, char* argv[]) {
+    try {
+        Options opt(argc, argv, 1);
+        if (opt.has("help")) {
+            std::cerr << "Usage: tls_bench [--ciphersuites=a:b] [--groups=a:b] [--cert=ecdsa:rsa]"
+                " [--seconds=2] [--bulk-mb=256] [--provider=..] [--engine=..]\n";
+            return 1;
+        }
+        TlsConfig backend = tls_config_from(opt);
+        load_crypto_backend(backend);
+
+        auto suites = split(opt.get("ciphersuites", "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256"), ':');
+        auto groups = split(opt.get("groups", "X25519:P-256"), ':');
+        auto certs = split(opt.get("cert", "ecdsa:rsa"), ':');
+        for (const auto& cert : certs) {
+            if (cert != "ecdsa" && cert != "rsa") throw std::runtime_error("unknown --cert " + cert + " (ecdsa|rsa)");
+        }
+        double seconds = opt.get_double("seconds", 2.0);
+        double bulk_mb = opt.get_double("bulk-mb", 256);
+
+        std::cout << "ciphersuite,group,cert,handshakes_per_sec_core,server_handshakes_per_sec_core,bulk_mb_per_sec\n";
+        for (const auto& cert : certs) {
+            PkeyPtr key = make_key(cert);
+            X509Ptr x = make_cert(key.get());
+            for (const auto& group : groups) {
+                for (const auto& suite : suites) {
+                    Bench b({ suite, group, cert }, key.get(), x.get());
+                    auto hs = b.handshakes(seconds);
+                    double mbps = b.bulk(bulk_mb);
+                    char line[256];
+                    std::snprintf(line, sizeof(line), "%s,%s,%s,%.1f,%.1f,%.1f",
+                        suite.c_str(), group.c_str(), cert.c_str(), hs.first, hs.second, mbps);
+                    std::cout << line << std::endl;
+                }
+            }
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+}
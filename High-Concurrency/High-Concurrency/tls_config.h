@@ -0,0 +1,135 @@
+﻿#pragma once
+#include <boost/asio/ip/address.hpp>
+#include <boost/asio/ssl.hpp>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/provider.h>
+#endif
+#if !defined(OPENSSL_NO_ENGINE) && OPENSSL_VERSION_NUMBER < 0x30000000L
+#include <openssl/engine.h>
+#endif
+#include <stdexcept>
+#include <string>
+#include "options.h"
+
+// TLS 加密組合設定：ciphersuite / key-exchange group / 憑證種類 / provider
+struct TlsConfig {
+    std::string ciphersuites; // 例: TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256
+    std::string groups;       // 例: X25519:P-256
+    std::string cert;         // ecdsa / rsa / both，空字串 = server.pem
+    std::string ca_file;      // client 端有指定才做 verify_peer 與主機名稱驗證
+    std::string provider;     // OpenSSL 3 provider 名稱
+    std::string engine;       // OpenSSL 1.1 engine id
+};
+
+inline TlsConfig tls_config_from(const Options& opt) {
+    TlsConfig cfg;
+    cfg.ciphersuites = opt.get("ciphersuites");
+    cfg.groups = opt.get("groups");
+    cfg.cert = opt.get("cert");
+    cfg.ca_file = opt.get("ca");
+    cfg.provider = opt.get("provider");
+    cfg.engine = opt.get("engine");
+    return cfg;
+}
+
+inline std::string openssl_error(const std::string& what) {
+    char buf[256] = { 0 };
+    ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+    return what + ": " + buf;
+}
+
+// 載入 provider / engine，需在建立 ssl::context 之前呼叫
+inline void load_crypto_backend(const TlsConfig& cfg) {
+    if (!cfg.provider.empty()) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        // 指定 provider 後 default 不會自動載入，要一併載入
+        if (!OSSL_PROVIDER_load(nullptr, cfg.provider.c_str()))
+            throw std::runtime_error(openssl_error("load provider " + cfg.provider));
+        if (cfg.provider != "default" && !OSSL_PROVIDER_load(nullptr, "default"))
+            throw std::runtime_error(openssl_error("load provider default"));
+#else
+        throw std::runtime_error("--provider needs OpenSSL 3.0");
+#endif
+    }
+    if (!cfg.engine.empty()) {
+#if !defined(OPENSSL_NO_ENGINE) && OPENSSL_VERSION_NUMBER < 0x30000000L
+        ENGINE_load_builtin_engines();
+        ENGINE* e = ENGINE_by_id(cfg.engine.c_str());
+        if (e == nullptr || !ENGINE_init(e))
+            throw std::runtime_error(openssl_error("load engine " + cfg.engine));
+        ENGINE_set_default(e, ENGINE_METHOD_ALL);
+        ENGINE_finish(e);
+        ENGINE_free(e);
+#else
+        throw std::runtime_error("--engine is not available in this OpenSSL build, use --provider");
+#endif
+    }
+}
+
+inline std::string sigalgs_for_cert(const std::string& cert) {
+    if (cert == "ecdsa") return "ecdsa_secp256r1_sha256:ecdsa_secp384r1_sha384";
+    if (cert == "rsa") return "rsa_pss_rsae_sha256:rsa_pss_rsae_sha384:rsa_pss_rsae_sha512";
+    return "";
+}
+
+inline void apply_cipher_config(SSL_CTX* ctx, const TlsConfig& cfg) {
+    if (!cfg.ciphersuites.empty() && !SSL_CTX_set_ciphersuites(ctx, cfg.ciphersuites.c_str()))
+        throw std::runtime_error(openssl_error("ciphersuites " + cfg.ciphersuites));
+    if (!cfg.groups.empty() && !SSL_CTX_set1_groups_list(ctx, cfg.groups.c_str()))
+        throw std::runtime_error(openssl_error("groups " + cfg.groups));
+}
+
+// server: ecdsa -> server_ecdsa.pem, rsa -> server_rsa.pem, both = 兩張都載入由 client 的 sigalgs 決定
+inline void apply_server_tls_config(boost::asio::ssl::context& ctx, const TlsConfig& cfg) {
+    apply_cipher_config(ctx.native_handle(), cfg);
+
+    auto load = [&ctx](const std::string& pem) {
+        ctx.use_certificate_chain_file(pem);
+        ctx.use_private_key_file(pem, boost::asio::ssl::context::pem);
+    };
+    if (cfg.cert.empty()) load("server.pem");
+    else if (cfg.cert == "ecdsa" || cfg.cert == "rsa") load("server_" + cfg.cert + ".pem");
+    else if (cfg.cert == "both") {
+        load("server_ecdsa.pem");
+        load("server_rsa.pem");
+    }
+    else throw std::runtime_error("unknown --cert " + cfg.cert);
+}
+
+// client: --cert=ecdsa|rsa 用 sigalgs 指定要 server 出哪一種憑證，--ca 有給才驗證
+inline void apply_client_tls_config(boost::asio::ssl::context& ctx, const TlsConfig& cfg) {
+    if (!cfg.cert.empty() && cfg.cert != "ecdsa" && cfg.cert != "rsa")
+        throw std::runtime_error("unknown --cert " + cfg.cert);
+    apply_cipher_config(ctx.native_handle(), cfg);
+
+    std::string sigalgs = sigalgs_for_cert(cfg.cert);
+    if (!sigalgs.empty() && !SSL_CTX_set1_sigalgs_list(ctx.native_handle(), sigalgs.c_str()))
+        throw std::runtime_error(openssl_error("sigalgs " + sigalgs));
+
+    if (!cfg.ca_file.empty()) {
+        ctx.load_verify_file(cfg.ca_file);
+        ctx.set_verify_mode(boost::asio::ssl::verify_peer);
+    }
+    else {
+        ctx.set_verify_mode(boost::asio::ssl::verify_none); // 測試用，正式環境要給 --ca
+    }
+}
+
+// --ca 時每條連線在 handshake 前呼叫：送 SNI (IP 位址不送) 並要求憑證的 SAN / CN 符合 host，
+// 只驗 CA 的話任何同一個 CA 簽的憑證都會通過。沒給 --ca 時不做事
+template <class Stream>
+inline boost::system::error_code set_client_verify_host(boost::asio::ssl::stream<Stream>& stream, const TlsConfig& cfg,
+    const std::string& host) {
+    boost::system::error_code ec;
+    if (cfg.ca_file.empty()) return ec;
+    boost::system::error_code not_ip;
+    boost::asio::ip::make_address(host, not_ip);
+    if (not_ip && !SSL_set_tlsext_host_name(stream.native_handle(), host.c_str())) {
+        ERR_clear_error();
+        return boost::asio::error::invalid_argument;
+    }
+    stream.set_verify_callback(boost::asio::ssl::host_name_verification(host), ec);
+    return ec;
+}